@@ -0,0 +1,152 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Qt include.
+#include <QString>
+#include <QTextStream>
+#include <QFile>
+
+// md4qt include.
+#define MD4QT_QT_SUPPORT
+#include <md4qt/traits.hpp>
+#include <md4qt/parser.hpp>
+
+// C++ include.
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+
+//! Count of allocations made with global operator new.
+static std::atomic< unsigned long long int > g_allocations = 0;
+
+void *
+operator new( std::size_t size )
+{
+	++g_allocations;
+
+	if( auto p = std::malloc( size ? size : 1 ) )
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void
+operator delete( void * p ) noexcept
+{
+	std::free( p );
+}
+
+void
+operator delete( void * p, std::size_t ) noexcept
+{
+	std::free( p );
+}
+
+
+namespace /* anonymous */ {
+
+//! Count of reparses in each run.
+static const int c_reparses = 100;
+
+//! \return Markdown to parse, the given file or generated text.
+QString
+sample( int argc, char ** argv )
+{
+	if( argc > 1 )
+	{
+		QFile f( QString::fromLocal8Bit( argv[ 1 ] ) );
+
+		if( f.open( QIODevice::ReadOnly ) )
+			return QString::fromUtf8( f.readAll() );
+	}
+
+	QString md;
+
+	for( int i = 0; i < 200; ++i )
+	{
+		md.append( QStringLiteral( "# Heading %1\n\n"
+			"Paragraph with *emphasis*, **strong**, `code` and [link](#heading-%1).[^%1]\n\n"
+			"* item\n* item with [reference][ref]\n\n"
+			"> quote\n\n"
+			"```cpp\nint main() {}\n```\n\n"
+			"[^%1]: Footnote %1.\n\n" ).arg( i ) );
+	}
+
+	md.append( QStringLiteral( "[ref]: https://www.qt.io\n" ) );
+
+	return md;
+}
+
+//! Parse the text with the given parser.
+void
+parse( MD::Parser< MD::QStringTrait > & parser, QString & md )
+{
+	QTextStream stream( &md, QIODevice::ReadOnly );
+
+	parser.parse( stream, QStringLiteral( "benchmark.md" ) );
+}
+
+} /* namespace anonymous */
+
+
+//! Allocations per reparse with a parser constructed for each parse, like
+//! before, and with one parser that lives between parses, like ParsingThread
+//! and LinkedFiles do now. Optional argument is a Markdown file to parse.
+int
+main( int argc, char ** argv )
+{
+	auto md = sample( argc, argv );
+
+	{
+		// Warm up static data of md4qt and Qt.
+		MD::Parser< MD::QStringTrait > parser;
+		parse( parser, md );
+	}
+
+	auto before = g_allocations.load();
+
+	for( int i = 0; i < c_reparses; ++i )
+	{
+		MD::Parser< MD::QStringTrait > parser;
+		parse( parser, md );
+	}
+
+	const auto local = ( g_allocations.load() - before ) / c_reparses;
+
+	MD::Parser< MD::QStringTrait > parser;
+	parse( parser, md );
+
+	before = g_allocations.load();
+
+	for( int i = 0; i < c_reparses; ++i )
+		parse( parser, md );
+
+	const auto persistent = ( g_allocations.load() - before ) / c_reparses;
+
+	std::printf( "Allocations per reparse of %lld characters:\n"
+		"\tparser per parse: %llu\n"
+		"\tpersistent parser: %llu\n",
+		static_cast< long long int > ( md.size() ), local, persistent );
+
+	return 0;
+}
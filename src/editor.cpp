@@ -22,14 +22,19 @@
 
 // md-editor include.
 #include "editor.hpp"
-#include "syntaxvisitor.hpp"
+#include "syntaxhighlighter.hpp"
+#include "textsearch.hpp"
+#include "parsingthread.hpp"
 
 // Qt include.
 #include <QPainter>
 #include <QTextBlock>
 #include <QTextDocument>
+#include <QTimer>
+#include <QElapsedTimer>
 
 // C++ include.
+#include <algorithm>
 #include <functional>
 #include <utility>
 
@@ -50,11 +55,41 @@ struct EditorPrivate {
 	void initUi()
 	{
 		lineNumberArea = new LineNumberArea( q );
+		parsingThread = new ParsingThread( q );
+
+		QObject::connect( parsingThread, &ParsingThread::parsingDone,
+			q, &Editor::onParsingDone, Qt::QueuedConnection );
+
+		parsingThread->start();
 
 		QObject::connect( q, &Editor::cursorPositionChanged,
 			q, &Editor::highlightCurrentLine );
-		QObject::connect( q, &QPlainTextEdit::textChanged,
+		parsingTimer = new QTimer( q );
+		parsingTimer->setSingleShot( true );
+
+		QObject::connect( parsingTimer, &QTimer::timeout,
 			q, &Editor::onContentChanged );
+		QObject::connect( q, &QPlainTextEdit::textChanged,
+			q, &Editor::onTextChanged );
+		QObject::connect( q->document(), &QTextDocument::contentsChange,
+			q, &Editor::onContentsChange );
+		QObject::connect( q, &QPlainTextEdit::updateRequest,
+			q, &Editor::onUpdateRequest );
+
+		idleTimer = new QTimer( q );
+		idleTimer->setSingleShot( true );
+		idleTimer->setInterval( c_idleDelay );
+
+		QObject::connect( idleTimer, &QTimer::timeout, q,
+			[this]()
+			{
+				QElapsedTimer stage;
+				stage.start();
+
+				emit q->ready();
+
+				htmlTime = stage.elapsed();
+			} );
 
 		q->showLineNumbers( true );
 		q->applyFont( QFontDatabase::systemFont( QFontDatabase::FixedFont ) );
@@ -74,17 +109,522 @@ struct EditorPrivate {
 		q->setExtraSelections( tmp );
 	}
 
+	//! Create selections of found occurrences only around visible lines.
+	void materializeFound()
+	{
+		extraSelections.clear();
+
+		if( found.empty() )
+		{
+			foundFirstLine = -1;
+			foundLastLine = -1;
+
+			return;
+		}
+
+		static const QColor color = QColor( Qt::yellow );
+
+		const auto lines = visibleLines();
+		const auto height = lines.second - lines.first + 1;
+
+		foundFirstLine = qMax( 0ll, lines.first - height );
+		foundLastLine = lines.second + height;
+
+		auto last = q->document()->findBlockByNumber( foundLastLine );
+
+		if( !last.isValid() )
+			last = q->document()->lastBlock();
+
+		const auto from = q->document()->findBlockByNumber( foundFirstLine ).position();
+		const auto to = last.position() + last.length();
+
+		for( auto it = std::lower_bound( found.cbegin(), found.cend(), from,
+				[]( const TextMatch & m, qsizetype p ) { return m.start < p; } ),
+			end = found.cend(); it != end && it->start < to; ++it )
+		{
+			QTextEdit::ExtraSelection s;
+
+			s.format.setBackground( color );
+			s.cursor = QTextCursor( q->document() );
+			s.cursor.setPosition( it->start );
+			s.cursor.setPosition( it->start + it->length, QTextCursor::KeepAnchor );
+
+			extraSelections.append( s );
+		}
+	}
+
+	//! \return Occurrences of the highlighted text in the given text.
+	std::vector< TextMatch > search( const QString & text )
+	{
+		if( !regExp )
+			return findAll( text, highlightedText );
+
+		const auto re = cachedRegularExpression( highlightedText );
+
+		if( !re.isValid() )
+		{
+			findError = Editor::tr( "Invalid regular expression: %1" ).arg( re.errorString() );
+
+			return {};
+		}
+
+		auto result = RegExpSearchResult::Finished;
+
+		auto matches = findAll( text, re, c_regExpTimeBudget, &result );
+
+		if( result != RegExpSearchResult::Finished )
+			findError = regExpError( result, false );
+
+		return matches;
+	}
+
+	//! \return Error of not finished search with regular expression.
+	static QString regExpError( RegExpSearchResult result, bool replacing )
+	{
+		if( result == RegExpSearchResult::TimedOut )
+			return ( replacing ? Editor::tr( "Search is too slow, nothing was replaced." ) :
+				Editor::tr( "Search is too slow, not all occurrences are found." ) );
+
+		return ( replacing ?
+			Editor::tr( "Regular expression is too complex to match, nothing was replaced." ) :
+			Editor::tr( "Regular expression is too complex to match, not all occurrences are found." ) );
+	}
+
+	//! Update found occurrences after modification of the text. Occurrences
+	//! after the modification are shifted, only the modified window is searched
+	//! again. The window is widened by the length of the text, or is the lines
+	//! of the modification for regular expression.
+	void updateFound( qsizetype position, qsizetype removed, qsizetype added )
+	{
+		findError.clear();
+
+		const auto delta = added - removed;
+
+		qsizetype first = 0, last = 0, from = 0, to = 0;
+
+		if( regExp )
+		{
+			// Regular expression is matched by lines.
+			const auto firstBlock = q->document()->findBlock( position );
+			auto lastBlock = q->document()->findBlock( position + added );
+
+			if( !lastBlock.isValid() )
+				lastBlock = q->document()->lastBlock();
+
+			from = firstBlock.position();
+			to = lastBlock.position() + lastBlock.length() - 1;
+
+			first = std::lower_bound( found.cbegin(), found.cend(), from,
+				[]( const TextMatch & m, qsizetype p ) { return m.start < p; } ) -
+					found.cbegin();
+			last = std::lower_bound( found.cbegin() + first, found.cend(), to - delta,
+				[]( const TextMatch & m, qsizetype p ) { return m.start < p; } ) -
+					found.cbegin();
+		}
+		else
+		{
+			const auto length = highlightedText.size();
+
+			// Occurrences intersecting the modified text.
+			first = std::lower_bound( found.cbegin(), found.cend(), position,
+				[]( const TextMatch & m, qsizetype p ) { return m.start + m.length <= p; } ) -
+					found.cbegin();
+			last = std::lower_bound( found.cbegin() + first, found.cend(),
+				position + removed,
+				[]( const TextMatch & m, qsizetype p ) { return m.start < p; } ) -
+					found.cbegin();
+
+			// Search window ends at neighbour occurrences, so they are not overlapped.
+			from = qMax( qsizetype( 0 ), position - length + 1 );
+
+			if( first > 0 )
+				from = qMax( from, found[ first - 1 ].start + found[ first - 1 ].length );
+
+			to = qMin( position + added + length - 1,
+				static_cast< qsizetype > ( q->document()->characterCount() ) - 1 );
+
+			if( last < foundCount() )
+				to = qMin( to, found[ last ].start + delta );
+		}
+
+		for( auto i = last; i < foundCount(); ++i )
+			found[ i ].start += delta;
+
+		found.erase( found.cbegin() + first, found.cbegin() + last );
+
+		if( from < to )
+		{
+			QTextCursor c( q->document() );
+			c.setPosition( from );
+			c.setPosition( to, QTextCursor::KeepAnchor );
+
+			auto matches = search( c.selectedText() );
+
+			for( auto & m : matches )
+				m.start += from;
+
+			found.insert( found.cbegin() + first, matches.cbegin(), matches.cend() );
+		}
+
+		foundChanged = true;
+	}
+
+	//! \return Count of found occurrences.
+	qsizetype foundCount() const
+	{
+		return static_cast< qsizetype > ( found.size() );
+	}
+
+	//! \return Index of the first found occurrence ending after the position,
+	//! count of occurrences if there is no such.
+	qsizetype nextFound( qsizetype pos ) const
+	{
+		return std::upper_bound( found.cbegin(), found.cend(), pos,
+			[]( qsizetype p, const TextMatch & m ) { return p < m.start + m.length; } ) -
+				found.cbegin();
+	}
+
+	//! \return Index of the last found occurrence ending before the position,
+	//! count of occurrences if there is no such.
+	qsizetype prevFound( qsizetype pos ) const
+	{
+		const auto i = std::lower_bound( found.cbegin(), found.cend(), pos,
+			[]( const TextMatch & m, qsizetype p ) { return m.start + m.length < p; } ) -
+				found.cbegin();
+
+		return ( i > 0 ? i - 1 : foundCount() );
+	}
+
+	//! \return Index of the found occurrence selected in the editor, -1 if not selected.
+	qsizetype selectedFound() const
+	{
+		const auto c = q->textCursor();
+
+		if( !c.hasSelection() )
+			return -1;
+
+		const auto it = std::lower_bound( found.cbegin(), found.cend(), c.selectionStart(),
+			[]( const TextMatch & m, qsizetype p ) { return m.start < p; } );
+
+		if( it != found.cend() && it->start == c.selectionStart() &&
+			it->start + it->length == c.selectionEnd() )
+				return it - found.cbegin();
+
+		return -1;
+	}
+
+	//! Select found occurrence in the editor.
+	void selectFound( qsizetype i )
+	{
+		auto c = q->textCursor();
+		c.setPosition( found[ i ].start );
+		c.setPosition( found[ i ].start + found[ i ].length, QTextCursor::KeepAnchor );
+		q->setTextCursor( c );
+	}
+
+	//! \return Can't the document be parsed by slices if it has the given line?
+	static bool breaksSlice( const QString & line )
+	{
+		const auto l = QStringView( line ).trimmed();
+
+		return ( l.startsWith( QStringLiteral( "```" ) ) || l.startsWith( QStringLiteral( "~~~" ) ) ||
+			l.startsWith( QLatin1Char( '<' ) ) || l.contains( QStringLiteral( "$$" ) ) ||
+			isReferenceDefinition( line ) );
+	}
+
+	//! Queue parsing of the modified top-level blocks only.
+	//! \return false if the whole document should be parsed.
+	bool prepareSliceParsing()
+	{
+		if( !currentDoc || forceFullParsing || changedFrom < 0 ||
+			currentDocCounter + 1 != currentParsingCounter )
+				return false;
+
+		const auto & items = currentDoc->items();
+		const long long int count = static_cast< long long int > ( items.size() );
+		const long long int firstContent =
+			( count && items.front()->type() == MD::ItemType::Anchor ? 1 : 0 );
+
+		if( count <= firstContent )
+			return false;
+
+		// Modified lines in the numbering of the current document.
+		const long long int oldFrom = changedFrom;
+		const long long int oldTo = qMax( changedFrom, changedTo - linesDelta );
+
+		const auto begin = items.cbegin() + firstContent;
+
+		const long long int first = std::partition_point( begin, items.cend(),
+			[oldFrom]( const auto & i ) { return i->endLine() < oldFrom; } ) - items.cbegin();
+		const long long int last = std::partition_point( begin, items.cend(),
+			[oldTo]( const auto & i ) { return i->startLine() <= oldTo; } ) - items.cbegin() - 1;
+
+		// Take one neighbour block from each side, modification may join or split blocks.
+		const long long int lo = qMax( firstContent, qMin( first, last + 1 ) - 1 );
+		const long long int hi = qMin( count - 1, qMax( last, first - 1 ) + 1 );
+
+		for( auto i = lo; i <= hi; ++i )
+		{
+			if( items[ i ]->type() == MD::ItemType::Code ||
+				items[ i ]->type() == MD::ItemType::RawHtml )
+					return false;
+		}
+
+		const long long int startLine =
+			( lo == firstContent ? 0 : qMin( items[ lo ]->startLine(), oldFrom ) );
+		const long long int oldEndLine = ( hi == count - 1 ? blockCount - 1 - linesDelta :
+			qMax( items[ hi ]->endLine(), oldTo ) );
+		const long long int linesCount = oldEndLine + linesDelta - startLine + 1;
+
+		if( linesCount <= 0 || linesCount * 2 > blockCount )
+			return false;
+
+		if( parsingThread->hasDefinitions( startLine, oldEndLine ) )
+			return false;
+
+		QString md;
+		auto block = q->document()->findBlockByNumber( startLine );
+
+		for( long long int i = 0; i < linesCount && block.isValid(); ++i, block = block.next() )
+		{
+			const auto text = block.text();
+
+			// Line separator becomes a line break in the whole text, so lines of
+			// the slice wouldn't match lines of the document.
+			if( breaksSlice( text ) || text.contains( QChar::LineSeparator ) )
+				return false;
+
+			md.append( text );
+			md.append( QLatin1Char( '\n' ) );
+		}
+
+		slice = { currentParsingCounter, lo, hi, oldEndLine, linesDelta };
+
+		parsingThread->prepareSlice( std::move( md ), docName, currentParsingCounter,
+			startLine, linesCount, oldEndLine, linesDelta );
+
+		return true;
+	}
+
+	//! Replace modified top-level blocks of the current document with the parsed slice.
+	//! Result is a new document, holders of the current one see it unchanged.
+	void spliceSlice( std::shared_ptr< MD::Document< MD::QStringTrait > > doc )
+	{
+		auto spliced = std::make_shared< MD::Document< MD::QStringTrait > > ();
+
+		const auto & items = currentDoc->items();
+		const long long int count = static_cast< long long int > ( items.size() );
+
+		for( long long int i = 0; i < slice.firstItem; ++i )
+			spliced->appendItem( items[ i ] );
+
+		for( const auto & item : doc->items() )
+			spliced->appendItem( item );
+
+		// Items below the slice are shared with the current document, so they are
+		// copied before shifting.
+		for( auto i = slice.lastItem + 1; i < count; ++i )
+		{
+			if( slice.delta )
+			{
+				auto item = items[ i ]->clone();
+				shiftItemLines( item.get(), slice.delta );
+				spliced->appendItem( item );
+			}
+			else
+				spliced->appendItem( items[ i ] );
+		}
+
+		for( const auto & f : currentDoc->footnotesMap() )
+		{
+			if( slice.delta && f.second->startLine() > slice.oldEndLine )
+			{
+				auto footnote = std::static_pointer_cast< MD::Footnote< MD::QStringTrait > > (
+					f.second->clone() );
+				shiftItemLines( footnote.get(), slice.delta );
+				spliced->insertFootnote( f.first, footnote );
+			}
+			else
+				spliced->insertFootnote( f.first, f.second );
+		}
+
+		for( const auto & l : currentDoc->labeledLinks() )
+			spliced->insertLabeledLink( l.first, l.second );
+
+		// Headings of the slice replace removed ones, shifted headings are copies.
+		restoreLabeledHeadings( spliced.get(), spliced.get() );
+
+		currentDoc = spliced;
+	}
+
+	//! \return First and last visible lines.
+	std::pair< long long int, long long int > visibleLines() const
+	{
+		const long long int first = q->firstVisibleBlock().blockNumber();
+		const long long int last = q->cursorForPosition(
+			QPoint( 0, q->viewport()->height() ) ).blockNumber();
+
+		return { first, qMax( first, last ) };
+	}
+
+	//! Highlight modified lines with the line lexer till the document is parsed.
+	void preHighlight()
+	{
+		if( lexFrom < 0 )
+			return;
+
+		if( colors.enabled && !largeDocument )
+		{
+			// View follows the cursor after modification.
+			const auto lines = visibleLines();
+			const long long int cursor = q->textCursor().blockNumber();
+			const auto height = lines.second - lines.first;
+
+			syntax.preHighlight( lexFrom, lexTo, cursor - height, cursor + height );
+		}
+
+		lexFrom = -1;
+		lexTo = -1;
+	}
+
+	//! \return Does the current document correspond to the text?
+	bool isDocInSync() const
+	{
+		return ( currentDoc && currentDocCounter == currentParsingCounter && changedFrom < 0 );
+	}
+
+	//! Switch into or out of large-document mode depending on stage times and size.
+	void checkTimeBudget()
+	{
+		const auto size = q->document()->characterCount();
+
+		if( !largeDocument )
+		{
+			if( parseTime + highlightTime + htmlTime > timeBudget )
+			{
+				largeDocument = true;
+				largeDocumentSize = size;
+
+				syntax.clearHighlighting();
+
+				emit q->largeDocumentModeChanged( true );
+			}
+		}
+		// Times are not representative in this mode, so document should shrink
+		// noticeably to switch back.
+		else if( size * 4 < largeDocumentSize * 3 )
+		{
+			largeDocument = false;
+			idleTimer->stop();
+
+			emit q->largeDocumentModeChanged( false );
+
+			if( colors.enabled )
+				q->highlightSyntax();
+
+			emit q->ready();
+		}
+	}
+
+	void resetChangedLines()
+	{
+		changedFrom = -1;
+		changedTo = -1;
+		linesDelta = 0;
+		forceFullParsing = false;
+	}
+
 	Editor * q = nullptr;
 	LineNumberArea * lineNumberArea = nullptr;
 	QString docName;
 	bool showLineNumberArea = true;
+	//! Selections of found occurrences around visible lines.
 	QList< QTextEdit::ExtraSelection > extraSelections;
+	//! Found occurrences of the highlighted text.
+	std::vector< TextMatch > found;
+	//! First line with created selections of found occurrences.
+	long long int foundFirstLine = -1;
+	//! Last line with created selections of found occurrences.
+	long long int foundLastLine = -1;
+	//! Were found occurrences changed by modification of the text?
+	bool foundChanged = false;
+	//! Is highlighted text a regular expression?
+	bool regExp = false;
+	//! Error of the last search, empty if there is no error.
+	QString findError;
+	//! Time budget of regular expression search, in milliseconds.
+	static const qint64 c_regExpTimeBudget = 1000;
 	QList< QTextEdit::ExtraSelection > syntaxHighlighting;
 	QTextEdit::ExtraSelection currentLine;
 	QString highlightedText;
 	Colors colors;
 	std::shared_ptr< MD::Document< MD::QStringTrait > > currentDoc;
-	SyntaxVisitor syntax;
+	SyntaxHighlighter syntax;
+	ParsingThread * parsingThread = nullptr;
+	unsigned long long int currentParsingCounter = 0;
+	//! Counter of the data of the current document.
+	unsigned long long int currentDocCounter = 0;
+	//! First modified line since last queued parsing.
+	long long int changedFrom = -1;
+	//! Last modified line since last queued parsing.
+	long long int changedTo = -1;
+	//! Change of lines count since last queued parsing.
+	long long int linesDelta = 0;
+	//! First modified line not yet highlighted by the line lexer.
+	long long int lexFrom = -1;
+	//! Last modified line not yet highlighted by the line lexer.
+	long long int lexTo = -1;
+	//! Lines count of the document.
+	int blockCount = 1;
+	//! Slice parsing can't be used.
+	bool forceFullParsing = false;
+
+	//! Delays parsing while user types.
+	QTimer * parsingTimer = nullptr;
+	//! Time since the first not yet handled text change.
+	QElapsedTimer pendingTime;
+	//! Time since start of the parsing.
+	QElapsedTimer pipelineTimer;
+	//! Duration of the last parse -> highlight -> HTML run, in milliseconds.
+	qint64 pipelineTime = 0;
+	//! Current delay before parsing, in milliseconds.
+	int pipelineDelay = 0;
+	//! Count of text changes that didn't start own run.
+	unsigned long long int skippedRuns = 0;
+
+	//! Delay of preview update in large-document mode, in milliseconds.
+	static const int c_idleDelay = 1500;
+
+	//! Time budget of parse -> highlight -> HTML run, in milliseconds.
+	int timeBudget = 1000;
+	//! Duration of the last parsing, in milliseconds.
+	qint64 parseTime = 0;
+	//! Duration of the last highlighting, in milliseconds.
+	qint64 highlightTime = 0;
+	//! Duration of the last HTML update, in milliseconds.
+	qint64 htmlTime = 0;
+	//! Is the document in large-document mode?
+	bool largeDocument = false;
+	//! Size of the document when it was switched into large-document mode.
+	int largeDocumentSize = 0;
+	//! Emits ready() when user is idle in large-document mode.
+	QTimer * idleTimer = nullptr;
+
+	//! Queued slice of the document.
+	struct Slice {
+		//! Counter of the data.
+		unsigned long long int counter = 0;
+		//! First replaced top-level item.
+		long long int firstItem = 0;
+		//! Last replaced top-level item.
+		long long int lastItem = -1;
+		//! Last line of the slice before modification.
+		long long int oldEndLine = 0;
+		//! Change of lines count.
+		long long int delta = 0;
+	}; // struct Slice
+
+	Slice slice;
 }; // struct EditorPrivate
 
 
@@ -101,33 +641,69 @@ Editor::Editor( QWidget * parent )
 
 Editor::~Editor()
 {
+	d->parsingThread->stop();
+	d->parsingThread->wait();
 }
 
 bool
 Editor::foundHighlighted() const
 {
-	return !d->extraSelections.isEmpty();
+	return !d->found.empty();
 }
 
 bool
 Editor::foundSelected() const
 {
-	const auto c = textCursor();
+	return ( d->selectedFound() >= 0 );
+}
+
+std::shared_ptr< MD::Document< MD::QStringTrait > >
+Editor::parseNow()
+{
+	if( d->parsingTimer->isActive() || d->changedFrom >= 0 || d->forceFullParsing ||
+		!d->currentParsingCounter )
+			onContentChanged();
 
-	for( const auto & s : std::as_const( d->extraSelections ) )
+	if( d->currentDocCounter != d->currentParsingCounter )
 	{
-		if( c.position() == s.cursor.position() )
-		{
-			if( c.hasSelection() &&
-				c.selectionStart() == s.cursor.selectionStart() &&
-				c.selectionEnd() == s.cursor.selectionEnd() )
-					return true;
-			else
-				return false;
-		}
+		std::shared_ptr< MD::Document< MD::QStringTrait > > doc;
+		std::shared_ptr< SyntaxSpans > spans;
+
+		if( d->parsingThread->waitForResult( d->currentParsingCounter, doc, spans ) )
+			onParsingDone( doc, spans, d->currentParsingCounter );
 	}
 
-	return false;
+	return d->currentDoc;
+}
+
+qsizetype
+Editor::foundCount() const
+{
+	return d->foundCount();
+}
+
+qsizetype
+Editor::foundIndex() const
+{
+	return d->selectedFound();
+}
+
+void
+Editor::setFindRegExp( bool on )
+{
+	d->regExp = on;
+}
+
+bool
+Editor::isFindRegExp() const
+{
+	return d->regExp;
+}
+
+const QString &
+Editor::findError() const
+{
+	return d->findError;
 }
 
 void
@@ -135,10 +711,13 @@ Editor::applyColors( const Colors & colors )
 {
 	d->colors = colors;
 
-	if( d->colors.enabled )
-		onContentChanged();
-	else
+	d->syntax.setColors( colors );
+
+	// Spans of the last parsing are kept, so new colors don't need parsing.
+	if( !d->colors.enabled )
 		d->syntax.clearHighlighting();
+	else if( !d->largeDocument )
+		highlightSyntax();
 
 	viewport()->update();
 }
@@ -156,12 +735,16 @@ Editor::applyFont( const QFont & f )
 
 	d->syntax.setFont( f );
 
-	highlightSyntax( d->colors, d->currentDoc );
+	if( d->colors.enabled && !d->largeDocument )
+		highlightSyntax();
 }
 
 void
 Editor::setDocName( const QString & name )
 {
+	if( d->docName != name )
+		d->forceFullParsing = true;
+
 	d->docName = name;
 }
 
@@ -375,101 +958,45 @@ Editor::showLineNumbers( bool on )
 	updateLineNumberAreaWidth( 0 );
 }
 
-namespace /* anonymous */ {
-
-template< class Iterator, class C = std::less<> >
-bool markSelection( Iterator first, Iterator last, QTextCursor c, Editor * e, C cmp = C{} )
-{
-	for( ; first != last; ++first )
-	{
-		if( cmp( c.position(), first->cursor.position() ) )
-		{
-			c.setPosition( first->cursor.selectionStart() );
-			c.setPosition( first->cursor.selectionEnd(), QTextCursor::KeepAnchor );
-			e->setTextCursor( c );
-
-			return true;
-		}
-	}
-
-	return false;
-}
-
-} /* namespace anonymous */
-
 void
 Editor::highlight( const QString & text, bool initCursor )
 {
 	d->highlightedText = text;
+	d->findError.clear();
 
-	d->extraSelections.clear();
-
-	if( !text.isEmpty() )
-	{
-		QTextCursor c( document() );
-
-		static const QColor color = QColor( Qt::yellow );
-
-		while( !c.isNull() )
-		{
-			QTextEdit::ExtraSelection s;
-
-			s.format.setBackground( color );
-			s.cursor = document()->find( text, c, QTextDocument::FindCaseSensitively );
-
-			if( !s.cursor.isNull() )
-				d->extraSelections.append( s );
-
-			c = s.cursor;
-		}
-	}
+	// Positions in the raw text are positions in the document.
+	d->found = d->search( document()->toRawText() );
 
+	d->materializeFound();
 	d->setExtraSelections();
 
-	if( !d->extraSelections.isEmpty() && initCursor )
+	if( !d->found.empty() && initCursor )
 	{
-		if( !markSelection( d->extraSelections.cbegin(), d->extraSelections.cend(),
-			QTextCursor( firstVisibleBlock() ), this ) )
-		{
-			markSelection( d->extraSelections.crbegin(), d->extraSelections.crend(),
-				QTextCursor( firstVisibleBlock() ), this, std::greater<> {} );
-		}
+		const auto i = d->nextFound( firstVisibleBlock().position() );
+
+		d->selectFound( i < d->foundCount() ? i : d->foundCount() - 1 );
 	}
 }
 
 void
 Editor::onFindNext()
 {
-	if( !d->extraSelections.isEmpty() )
-	{		
-		if( !markSelection( d->extraSelections.cbegin(), d->extraSelections.cend(),
-			textCursor(), this ) )
-		{
-			auto s = d->extraSelections.at( 0 ).cursor;
-			auto c = textCursor();
-			c.setPosition( s.selectionStart() );
-			c.setPosition( s.selectionEnd(), QTextCursor::KeepAnchor );
-			setTextCursor( c );
-		}
+	if( !d->found.empty() )
+	{
+		const auto i = d->nextFound( textCursor().position() );
+
+		d->selectFound( i < d->foundCount() ? i : 0 );
 	}
 }
 
 void
 Editor::onFindPrev()
 {
-	if( !d->extraSelections.isEmpty() )
+	if( !d->found.empty() )
 	{
-		auto c = textCursor();
+		const auto i = d->prevFound( textCursor().position() );
 
-		if( !markSelection( d->extraSelections.crbegin(), d->extraSelections.crend(),
-			textCursor(), this, std::greater<> {} ) )
-		{
-			auto s = d->extraSelections.at( d->extraSelections.size() - 1 ).cursor;
-			auto c = textCursor();
-			c.setPosition( s.selectionStart() );
-			c.setPosition( s.selectionEnd(), QTextCursor::KeepAnchor );
-			setTextCursor( c );
-		}
+		d->selectFound( i < d->foundCount() ? i : d->foundCount() - 1 );
 	}
 }
 
@@ -477,8 +1004,10 @@ void
 Editor::clearExtraSelections()
 {
 	d->highlightedText.clear();
-	d->extraSelections.clear();
+	d->findError.clear();
+	d->found.clear();
 
+	d->materializeFound();
 	d->setExtraSelections();
 }
 
@@ -488,9 +1017,24 @@ Editor::replaceCurrent( const QString & with )
 	if( foundSelected() )
 	{
 		auto c = textCursor();
+		auto replacement = with;
+
+		if( d->regExp )
+		{
+			// Occurrence is matched again in its line for captures, so anchors
+			// and lookarounds see the same context.
+			const auto block = document()->findBlock( c.selectionStart() );
+			const auto m = cachedRegularExpression( d->highlightedText ).match( block.text(),
+				c.selectionStart() - block.position(), QRegularExpression::NormalMatch,
+				QRegularExpression::AnchorAtOffsetMatchOption );
+
+			if( m.hasMatch() )
+				replacement = substituteCaptures( m, with );
+		}
+
 		c.beginEditBlock();
 		c.removeSelectedText();
-		c.insertText( with );
+		c.insertText( replacement );
 		c.endEditBlock();
 	}
 }
@@ -500,51 +1044,269 @@ Editor::replaceAll( const QString & with )
 {
 	if( foundHighlighted() )
 	{
-		disconnect( this, &QPlainTextEdit::textChanged, this, &Editor::onContentChanged );
+		const auto text = d->highlightedText;
+		const auto raw = document()->toRawText();
 
-		QTextCursor editCursor( document() );
+		std::vector< TextMatch > matches;
+		QStringList replacements;
+		qsizetype replacementsSize = 0;
 
-		editCursor.beginEditBlock();
+		if( d->regExp )
+		{
+			// Captures are substituted in the same pass.
+			const auto result = forEachMatch( raw, cachedRegularExpression( text ),
+				EditorPrivate::c_regExpTimeBudget,
+				[&]( const QRegularExpressionMatch & m, qsizetype offset )
+				{
+					matches.push_back( { offset + m.capturedStart(), m.capturedLength() } );
+					replacements.append( substituteCaptures( m, with ) );
+					replacementsSize += replacements.back().size();
+				} );
+
+			if( result != RegExpSearchResult::Finished )
+			{
+				d->findError = EditorPrivate::regExpError( result, true );
 
-		QTextCursor found = editCursor;
+				emit foundChanged();
 
-		while( !found.isNull() )
+				return;
+			}
+		}
+		else
 		{
-			found = document()->find( d->highlightedText, editCursor,
-				QTextDocument::FindCaseSensitively );
+			matches = findAll( raw, text );
+			replacementsSize = static_cast< qsizetype > ( matches.size() ) * with.size();
+		}
 
-			if( !found.isNull() )
-			{
-				editCursor.setPosition( found.selectionStart() );
-				editCursor.setPosition( found.selectionEnd(), QTextCursor::KeepAnchor );
+		clearExtraSelections();
 
-				editCursor.removeSelectedText();
-				editCursor.insertText( with );
-			}
+		if( matches.empty() )
+			return;
+
+		const auto from = matches.front().start;
+		const auto to = matches.back().start + matches.back().length;
+
+		QString result;
+		result.reserve( to - from + replacementsSize );
+
+		auto pos = from;
+
+		for( size_t i = 0; i < matches.size(); ++i )
+		{
+			result.append( QStringView( raw ).sliced( pos, matches[ i ].start - pos ) );
+			result.append( d->regExp ? replacements.at( i ) : with );
+
+			pos = matches[ i ].start + matches[ i ].length;
 		}
 
-		editCursor.endEditBlock();
+		// All occurrences are replaced with one edit, so it's one undo step and
+		// one relayout.
+		QTextCursor c( document() );
+		c.beginEditBlock();
+		c.setPosition( from );
+		c.setPosition( to, QTextCursor::KeepAnchor );
+		c.insertText( result );
+		c.endEditBlock();
 
-		clearExtraSelections();
+		onContentChanged();
+	}
+}
+
+int
+Editor::pipelineDelay() const
+{
+	return d->pipelineDelay;
+}
+
+qint64
+Editor::pipelineTime() const
+{
+	return d->pipelineTime;
+}
+
+unsigned long long int
+Editor::skippedRuns() const
+{
+	return d->skippedRuns;
+}
+
+void
+Editor::setTimeBudget( int ms )
+{
+	d->timeBudget = ms;
+}
+
+int
+Editor::timeBudget() const
+{
+	return d->timeBudget;
+}
+
+bool
+Editor::isLargeDocument() const
+{
+	return d->largeDocument;
+}
+
+void
+Editor::onTextChanged()
+{
+	if( d->syntax.isApplyingFormats() )
+		return;
+
+	d->preHighlight();
+
+	if( d->foundChanged )
+	{
+		d->foundChanged = false;
+
+		d->materializeFound();
+		d->setExtraSelections();
+
+		emit foundChanged();
+	}
+
+	// Preview of large document waits till user stops typing.
+	if( d->idleTimer->isActive() )
+		d->idleTimer->start();
+
+	if( d->parsingTimer->isActive() )
+	{
+		++d->skippedRuns;
+
+		// Don't postpone update forever while user types.
+		if( d->pendingTime.elapsed() >= d->pipelineDelay * 3 )
+			return;
 	}
+	else
+		d->pendingTime.start();
 
-	connect( this, &QPlainTextEdit::textChanged, this, &Editor::onContentChanged );
+	d->parsingTimer->start( d->pipelineDelay );
 }
 
 void
 Editor::onContentChanged()
 {
-	auto md = toPlainText();
-	QTextStream stream( &md );
+	d->parsingTimer->stop();
+	d->pipelineTimer.start();
+
+	++d->currentParsingCounter;
+
+	if( !d->prepareSliceParsing() )
+		d->parsingThread->prepare( document()->toRawText(), d->docName,
+			d->currentParsingCounter );
+
+	d->resetChangedLines();
+}
+
+void
+Editor::onContentsChange( int position, int charsRemoved, int charsAdded )
+{
+	if( ( !charsRemoved && !charsAdded ) || d->syntax.isApplyingFormats() )
+		return;
 
-	MD::Parser< MD::QStringTrait > parser;
+	d->syntax.stopBackgroundHighlighting();
 
-	d->currentDoc = parser.parse( stream, d->docName );
+	const auto count = document()->blockCount();
+	const long long int delta = count - d->blockCount;
+	d->blockCount = count;
 
-	if( d->colors.enabled )
-		highlightSyntax( d->colors, d->currentDoc );
+	const long long int first = document()->findBlock( position ).blockNumber();
+	const long long int last = document()->findBlock( position + charsAdded ).blockNumber();
 
-	highlightCurrent();
+	if( d->changedFrom < 0 )
+	{
+		d->changedFrom = first;
+		d->changedTo = last;
+	}
+	else
+	{
+		if( d->changedTo >= first )
+			d->changedTo = qMax( first, d->changedTo + delta );
+
+		d->changedFrom = qMin( d->changedFrom, first );
+		d->changedTo = qMax( d->changedTo, last );
+	}
+
+	d->linesDelta += delta;
+
+	d->lexFrom = ( d->lexFrom < 0 ? first : qMin( d->lexFrom, first ) );
+	d->lexTo = qMax( d->lexTo, last );
+
+	if( !d->highlightedText.isEmpty() )
+		d->updateFound( position, charsRemoved, charsAdded );
+}
+
+void
+Editor::onParsingDone( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+	std::shared_ptr< SyntaxSpans > spans, unsigned long long int counter )
+{
+	// Text was changed after this data was queued, newer result is on the way.
+	// Result that was waited for in parseNow() is already accepted.
+	if( counter != d->currentParsingCounter || counter == d->currentDocCounter )
+		return;
+
+	if( d->slice.counter == counter && d->currentDoc )
+	{
+		d->spliceSlice( doc );
+		d->syntax.spliceSpans( spans, d->slice.oldEndLine );
+	}
+	else
+	{
+		d->currentDoc = doc;
+		d->syntax.setSpans( spans );
+	}
+
+	d->currentDocCounter = counter;
+	d->parseTime = d->pipelineTimer.elapsed();
+
+	QElapsedTimer stage;
+	stage.start();
+
+	if( d->colors.enabled && !d->largeDocument )
+		highlightSyntax();
+
+	d->highlightTime = stage.restart();
+
+	if( d->largeDocument )
+		d->idleTimer->start();
+	else
+	{
+		emit ready();
+
+		d->htmlTime = stage.elapsed();
+	}
+
+	d->pipelineTime = d->pipelineTimer.elapsed();
+
+	d->checkTimeBudget();
+
+	// Small documents are updated immediately, for big ones updates are
+	// coalesced for as long as the last run took.
+	static const qint64 c_immediateUpdateTime = 20;
+	static const qint64 c_maxPipelineDelay = 1000;
+
+	d->pipelineDelay = ( d->pipelineTime <= c_immediateUpdateTime ? 0 :
+		static_cast< int > ( qMin( d->pipelineTime, c_maxPipelineDelay ) ) );
+}
+
+void
+Editor::onUpdateRequest( const QRect &, int )
+{
+	if( !d->found.empty() )
+	{
+		const auto lines = d->visibleLines();
+
+		// Selections of found occurrences are created when they come into view.
+		if( lines.first < d->foundFirstLine || lines.second > d->foundLastLine )
+		{
+			d->materializeFound();
+			d->setExtraSelections();
+		}
+	}
+
+	if( d->colors.enabled && !d->largeDocument )
+		highlightSyntax();
 }
 
 void
@@ -584,10 +1346,15 @@ Editor::goToLine( int l )
 }
 
 void
-Editor::highlightSyntax( const Colors & colors,
-	std::shared_ptr< MD::Document< MD::QStringTrait > > doc )
+Editor::highlightSyntax()
 {
-	d->syntax.highlight( doc, colors );
+	// Spans are known only for the text that was parsed.
+	if( !d->isDocInSync() )
+		return;
+
+	const auto lines = d->visibleLines();
+
+	d->syntax.highlightVisible( lines.first, lines.second );
 }
 
 } /* namespace MdEditor */
@@ -28,6 +28,7 @@
 
 // md-editor include.
 #include "colors.hpp"
+#include "syntaxvisitor.hpp"
 
 // md4qt include.
 #define MD4QT_QT_SUPPORT
@@ -52,6 +53,12 @@ class Editor
 signals:
 	void lineHovered( int lineNumber, const QPoint & pos );
 	void hoverLeaved();
+	//! Document was parsed and highlighted, currentDoc() is up to date.
+	void ready();
+	//! Document switched into or out of large-document mode.
+	void largeDocumentModeChanged( bool on );
+	//! Found occurrences of the highlighted text were updated after modification.
+	void foundChanged();
 
 public:
 	explicit Editor( QWidget * parent );
@@ -64,9 +71,36 @@ public:
 	int lineNumberAreaWidth();
 	bool foundHighlighted() const;
 	bool foundSelected() const;
+	//! \return Count of found occurrences of the highlighted text.
+	qsizetype foundCount() const;
+	//! \return Index of the selected found occurrence, -1 if none is selected.
+	qsizetype foundIndex() const;
+	//! Set whether highlighted text is a regular expression. Replacement text
+	//! may reference captured groups as \1 or $1 then.
+	void setFindRegExp( bool on );
+	bool isFindRegExp() const;
+	//! \return Error of the last search, empty if there is no error.
+	const QString & findError() const;
 	void applyColors( const Colors & colors );
 	std::shared_ptr< MD::Document< MD::QStringTrait > > currentDoc() const;
+	//! Parse pending modifications of the text immediately and wait for the result.
+	//! \return Document of the current text.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > parseNow();
 	void applyFont( const QFont & f );
+	//! \return Current delay between text change and parsing, in milliseconds.
+	int pipelineDelay() const;
+	//! \return Duration of the last parse -> highlight -> HTML run, in milliseconds.
+	qint64 pipelineTime() const;
+	//! \return Count of text changes coalesced with other ones.
+	unsigned long long int skippedRuns() const;
+	//! Set time budget of parse -> highlight -> HTML run, in milliseconds.
+	//! Document exceeding it is switched into large-document mode.
+	void setTimeBudget( int ms );
+	//! \return Time budget of parse -> highlight -> HTML run, in milliseconds.
+	int timeBudget() const;
+	//! \return Is the document in large-document mode? In this mode syntax
+	//! highlighting is off and ready() is emitted only when user is idle.
+	bool isLargeDocument() const;
 
 public slots:
 	void showUnprintableCharacters( bool on );
@@ -85,9 +119,14 @@ private slots:
 	void updateLineNumberArea( const QRect & rect, int dy );
 	void onFindNext();
 	void onFindPrev();
+	void onTextChanged();
 	void onContentChanged();
-	void highlightSyntax( const Colors & colors,
-		std::shared_ptr< MD::Document< MD::QStringTrait > > doc );
+	void onContentsChange( int position, int charsRemoved, int charsAdded );
+	void onParsingDone( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+		std::shared_ptr< MdEditor::SyntaxSpans > spans, unsigned long long int counter );
+	void onUpdateRequest( const QRect & rect, int dy );
+	//! Highlight visible lines with spans of the last parsing.
+	void highlightSyntax();
 
 protected:
 	void resizeEvent( QResizeEvent * event ) override;
@@ -89,8 +89,28 @@ struct FindPrivate {
 			q, &Find::onReplaceAll );
 		QObject::connect( editor, &QPlainTextEdit::selectionChanged,
 			q, &Find::onSelectionChanged );
+		QObject::connect( editor, &Editor::foundChanged,
+			q, &Find::onSelectionChanged );
 		QObject::connect( ui.close, &QAbstractButton::clicked,
 			q, &Find::onClose );
+		QObject::connect( ui.regExpBox, &QCheckBox::toggled,
+			q, &Find::onRegExpToggled );
+	}
+
+	//! Show count of found occurrences and index of the selected one, or error of the search.
+	void updateCount()
+	{
+		const auto count = editor->foundCount();
+		const auto index = editor->foundIndex();
+
+		if( !editor->findError().isEmpty() )
+			ui.countLabel->setText( editor->findError() );
+		else if( !count )
+			ui.countLabel->clear();
+		else if( index >= 0 )
+			ui.countLabel->setText( Find::tr( "%1 of %2" ).arg( index + 1 ).arg( count ) );
+		else
+			ui.countLabel->setText( Find::tr( "%1 found" ).arg( count ) );
 	}
 
 	Find * q = nullptr;
@@ -146,6 +166,8 @@ Find::onFindTextChanged( const QString & str )
 	QPalette palette = d->ui.findEdit->palette();
 	palette.setColor( QPalette::Text, c );
 	d->ui.findEdit->setPalette( palette );
+
+	d->updateCount();
 }
 
 void
@@ -171,6 +193,8 @@ Find::setFocusOnFind()
 	d->ui.findEdit->selectAll();
 
 	d->editor->highlight( d->ui.findEdit->text(), true );
+
+	d->updateCount();
 }
 
 void
@@ -183,6 +207,8 @@ void
 Find::onReplaceAll()
 {
 	d->editor->replaceAll( d->ui.replaceEdit->text() );
+
+	d->updateCount();
 }
 
 void
@@ -192,6 +218,16 @@ Find::onSelectionChanged()
 		!d->ui.replaceEdit->text().isEmpty() );
 	d->ui.replaceAllBtn->setEnabled( d->editor->foundHighlighted() &&
 		!d->ui.replaceEdit->text().isEmpty() );
+
+	d->updateCount();
+}
+
+void
+Find::onRegExpToggled( bool on )
+{
+	d->editor->setFindRegExp( on );
+
+	onFindTextChanged( d->ui.findEdit->text() );
 }
 
 void
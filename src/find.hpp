@@ -65,6 +65,7 @@ private slots:
 	void onReplace();
 	void onReplaceAll();
 	void onSelectionChanged();
+	void onRegExpToggled( bool on );
 	void onClose();
 
 private:
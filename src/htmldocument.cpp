@@ -34,6 +34,8 @@ HtmlDocument::HtmlDocument( QObject * parent )
 void
 HtmlDocument::setText( const QString & text )
 {
+    m_sections.clear();
+
     if( text == m_text )
         return;
 
@@ -42,4 +44,62 @@ HtmlDocument::setText( const QString & text )
     emit textChanged( m_text );
 }
 
+void
+HtmlDocument::setSections( const QStringList & sections )
+{
+    m_sections = sections;
+
+    joinSections();
+
+    emit textChanged( m_text );
+}
+
+qsizetype
+HtmlDocument::sectionsCount() const
+{
+    return m_sections.size();
+}
+
+void
+HtmlDocument::setSection( qsizetype index, const QString & html )
+{
+    if( index < 0 || index >= m_sections.size() || m_sections.at( index ) == html )
+        return;
+
+    m_sections[ index ] = html;
+
+    // Text is kept in sync for reloading of the page, but the view
+    // is updated only in the given section.
+    joinSections();
+
+    emit sectionChanged( sectionId( index ), html );
+}
+
+void
+HtmlDocument::setPostProcessing( bool on )
+{
+    if( on == m_postProcessing )
+        return;
+
+    m_postProcessing = on;
+
+    emit postProcessingChanged( m_postProcessing );
+}
+
+QString
+HtmlDocument::sectionId( qsizetype index )
+{
+    return QStringLiteral( "md-section-%1" ).arg( index );
+}
+
+void
+HtmlDocument::joinSections()
+{
+    m_text.clear();
+
+    for( qsizetype i = 0; i < m_sections.size(); ++i )
+        m_text.append( QStringLiteral( "<div id=\"%1\">" ).arg( sectionId( i ) ) +
+            m_sections.at( i ) + QStringLiteral( "</div>" ) );
+}
+
 } /* namespace MdEditor */
@@ -25,6 +25,7 @@
 // Qt include.
 #include <QObject>
 #include <QString>
+#include <QStringList>
 
 
 namespace MdEditor {
@@ -38,9 +39,12 @@ class HtmlDocument
 {
     Q_OBJECT
     Q_PROPERTY( QString text MEMBER m_text NOTIFY textChanged FINAL )
+    Q_PROPERTY( bool postProcessing MEMBER m_postProcessing NOTIFY postProcessingChanged FINAL )
 
 signals:
     void textChanged( const QString & text );
+    void sectionChanged( const QString & id, const QString & html );
+    void postProcessingChanged( bool on );
 
 public:
     explicit HtmlDocument( QObject * parent );
@@ -48,8 +52,27 @@ public:
 
     void setText( const QString & text );
 
+    //! Set text as sections, each section can be updated separately.
+    void setSections( const QStringList & sections );
+    //! \return Count of sections.
+    qsizetype sectionsCount() const;
+    //! Update only one section.
+    void setSection( qsizetype index, const QString & html );
+
+    //! Enable or disable emoji and math post-processing of the page.
+    void setPostProcessing( bool on );
+
+    //! \return Id of HTML element of the section.
+    static QString sectionId( qsizetype index );
+
+private:
+    //! Rebuild text from sections.
+    void joinSections();
+
 private:
     QString m_text;
+    QStringList m_sections;
+    bool m_postProcessing = true;
 }; // class HtmlDocument
 
 } /* namespace MdEditor */
@@ -0,0 +1,573 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-editor include.
+#include "linkedfiles.hpp"
+#include "parsecache.hpp"
+
+// Qt include.
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QMap>
+#include <QSet>
+#include <QtConcurrent>
+
+
+namespace MdEditor {
+
+namespace /* anonymous */ {
+
+//! \return Is the given file a Markdown file that should be loaded?
+bool
+isMarkdownFile( const QString & path )
+{
+	const QFileInfo info( path );
+
+	if( !info.exists() || !info.isFile() )
+		return false;
+
+	const auto suffix = info.suffix().toLower();
+
+	return ( suffix == QStringLiteral( "md" ) || suffix == QStringLiteral( "mkd" ) ||
+		suffix == QStringLiteral( "markdown" ) );
+}
+
+//! \return Path of the local file the link points to, or empty string.
+//! Links with fragment look like "#fragment/path/to/file.md" after parsing.
+QString
+linkedFilePath( const QString & url )
+{
+	if( url.startsWith( QLatin1Char( '#' ) ) )
+	{
+		for( auto pos = url.indexOf( QLatin1Char( '/' ) ); pos != -1;
+			pos = url.indexOf( QLatin1Char( '/' ), pos + 1 ) )
+		{
+			const auto path = url.sliced( pos );
+
+			if( isMarkdownFile( path ) )
+				return QFileInfo( path ).absoluteFilePath();
+
+			if( isMarkdownFile( path.sliced( 1 ) ) )
+				return QFileInfo( path.sliced( 1 ) ).absoluteFilePath();
+		}
+	}
+	else if( isMarkdownFile( url ) )
+		return QFileInfo( url ).absoluteFilePath();
+
+	return {};
+}
+
+//! Collect links to Markdown files in document order.
+void
+collectLinks( MD::Item< MD::QStringTrait > * item, QStringList & links )
+{
+	switch( item->type() )
+	{
+		case MD::ItemType::Link :
+		{
+			auto l = static_cast< MD::Link< MD::QStringTrait >* > ( item );
+
+			const auto path = linkedFilePath( l->url() );
+
+			if( !path.isEmpty() && !links.contains( path ) )
+				links.append( path );
+
+			if( l->p() )
+				collectLinks( l->p().get(), links );
+		}
+			break;
+
+		case MD::ItemType::Heading :
+		{
+			auto h = static_cast< MD::Heading< MD::QStringTrait >* > ( item );
+
+			if( h->text() )
+				collectLinks( h->text().get(), links );
+		}
+			break;
+
+		case MD::ItemType::Paragraph :
+		case MD::ItemType::Blockquote :
+		case MD::ItemType::List :
+		case MD::ItemType::ListItem :
+		case MD::ItemType::TableCell :
+		case MD::ItemType::Footnote :
+		{
+			auto b = static_cast< MD::Block< MD::QStringTrait >* > ( item );
+
+			for( const auto & i : b->items() )
+				collectLinks( i.get(), links );
+		}
+			break;
+
+		case MD::ItemType::Table :
+		{
+			auto t = static_cast< MD::Table< MD::QStringTrait >* > ( item );
+
+			for( const auto & r : t->rows() )
+				for( const auto & c : r->cells() )
+					collectLinks( c.get(), links );
+		}
+			break;
+
+		default :
+			break;
+	}
+}
+
+} /* namespace anonymous */
+
+
+//
+// LinkedFilesPrivate
+//
+
+struct LinkedFilesPrivate {
+	//! Merge parsed files into one document in the order of loading.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > merge()
+	{
+		auto doc = std::make_shared< MD::Document< MD::QStringTrait > > ();
+
+		ranges.clear();
+
+		for( const auto & path : std::as_const( order ) )
+		{
+			const auto & file = *files.constFind( path );
+
+			if( !doc->items().empty() && doc->items().back()->type() != MD::ItemType::PageBreak )
+				doc->appendItem( std::make_shared< MD::PageBreak< MD::QStringTrait > > () );
+
+			const auto first = static_cast< qsizetype > ( doc->items().size() );
+
+			for( const auto & item : file.doc->items() )
+				doc->appendItem( item );
+
+			ranges.insert( path,
+				{ first, static_cast< qsizetype > ( doc->items().size() ) - first } );
+
+			for( const auto & f : file.doc->footnotesMap() )
+				doc->insertFootnote( f.first, f.second );
+
+			for( const auto & l : file.doc->labeledLinks() )
+				doc->insertLabeledLink( l.first, l.second );
+
+			for( const auto & h : file.doc->labeledHeadings() )
+				doc->insertLabeledHeading( h.first, h.second );
+		}
+
+		combined = doc;
+
+		return doc;
+	}
+
+	//! Replace items and definitions of the reparsed files in the combined
+	//! document. Result is a new document, holders of the previous one see it
+	//! unchanged. Files are merged again only if their order was changed.
+	//! \a replaced are previous documents of the reparsed files.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > patch( const QStringList & previousOrder,
+		const QMap< QString, std::shared_ptr< MD::Document< MD::QStringTrait > > > & replaced )
+	{
+		if( !combined || order != previousOrder )
+			return merge();
+
+		if( replaced.isEmpty() )
+			return combined;
+
+		auto doc = std::make_shared< MD::Document< MD::QStringTrait > > ();
+		const auto & items = combined->items();
+		QMap< QString, std::pair< qsizetype, qsizetype > > patched;
+
+		for( const auto & path : std::as_const( order ) )
+		{
+			if( !doc->items().empty() && doc->items().back()->type() != MD::ItemType::PageBreak )
+				doc->appendItem( std::make_shared< MD::PageBreak< MD::QStringTrait > > () );
+
+			const auto first = static_cast< qsizetype > ( doc->items().size() );
+
+			// Items of unchanged files are taken from the previous combined document.
+			if( !replaced.contains( path ) )
+			{
+				const auto range = ranges.value( path );
+
+				for( auto i = range.first, last = range.first + range.second; i < last; ++i )
+					doc->appendItem( items[ i ] );
+			}
+			else
+			{
+				for( const auto & item : files.constFind( path )->doc->items() )
+					doc->appendItem( item );
+			}
+
+			patched.insert( path,
+				{ first, static_cast< qsizetype > ( doc->items().size() ) - first } );
+		}
+
+		ranges = patched;
+
+		// Definitions of the reparsed files are replaced with new ones.
+		QSet< QString > footnotes, links, headings;
+
+		for( const auto & old : replaced )
+		{
+			for( const auto & f : old->footnotesMap() )
+				footnotes.insert( f.first );
+
+			for( const auto & l : old->labeledLinks() )
+				links.insert( l.first );
+
+			for( const auto & h : old->labeledHeadings() )
+				headings.insert( h.first );
+		}
+
+		for( const auto & f : combined->footnotesMap() )
+		{
+			if( !footnotes.contains( f.first ) )
+				doc->insertFootnote( f.first, f.second );
+		}
+
+		for( const auto & l : combined->labeledLinks() )
+		{
+			if( !links.contains( l.first ) )
+				doc->insertLabeledLink( l.first, l.second );
+		}
+
+		for( const auto & h : combined->labeledHeadings() )
+		{
+			if( !headings.contains( h.first ) )
+				doc->insertLabeledHeading( h.first, h.second );
+		}
+
+		for( auto it = replaced.cbegin(), last = replaced.cend(); it != last; ++it )
+		{
+			const auto file = files.constFind( it.key() );
+
+			if( file == files.cend() )
+				continue;
+
+			for( const auto & f : file->doc->footnotesMap() )
+				doc->insertFootnote( f.first, f.second );
+
+			for( const auto & l : file->doc->labeledLinks() )
+				doc->insertLabeledLink( l.first, l.second );
+
+			for( const auto & h : file->doc->labeledHeadings() )
+				doc->insertLabeledHeading( h.first, h.second );
+		}
+
+		combined = doc;
+
+		return doc;
+	}
+
+	//! Parse files that are not loaded yet, and files linked from them.
+	void load( const LinkedFiles * q, QStringList level )
+	{
+		// Files are discovered level by level, each level is parsed in parallel.
+		// Order of loading doesn't matter, order of the combined document is
+		// built by reorder() afterwards.
+		QSet< QString > queued( level.cbegin(), level.cend() );
+
+		while( !level.isEmpty() )
+		{
+			const auto parsed = QtConcurrent::blockingMapped< QList< LinkedFile > > (
+				level, [q]( const QString & path ) { return q->parseFile( path ); } );
+
+			QStringList next;
+
+			for( const auto & file : parsed )
+			{
+				if( !file.doc )
+					continue;
+
+				files.insert( file.path, file );
+				updated.append( file.path );
+
+				if( file.doc->items().empty() )
+					continue;
+
+				for( const auto & link : file.links )
+				{
+					if( !files.contains( link ) && !queued.contains( link ) )
+					{
+						queued.insert( link );
+						next.append( link );
+					}
+				}
+			}
+
+			level = next;
+		}
+	}
+
+	//! Append the given file and files linked from it to the order, depth-first.
+	//! Just like MD::Parser in recursive mode, links that are still pending in
+	//! the parent file are left to the parent.
+	void visit( const QString & path, const QStringList * parentLinks,
+		QSet< QString > & visited )
+	{
+		visited.insert( path );
+
+		const auto it = files.constFind( path );
+
+		if( it == files.cend() || it->doc->items().empty() )
+			return;
+
+		order.append( path );
+
+		QStringList links;
+
+		for( const auto & link : it->links )
+		{
+			dependents[ link ].insert( path );
+
+			if( !parentLinks || !parentLinks->contains( link ) )
+				links.append( link );
+		}
+
+		while( !links.isEmpty() )
+		{
+			const auto next = links.takeFirst();
+
+			if( !visited.contains( next ) )
+				visit( next, &links, visited );
+		}
+	}
+
+	//! Rebuild order of files and reverse edges of the graph from forward ones.
+	//! Files that are not reachable from the root anymore are dropped.
+	void reorder()
+	{
+		order.clear();
+		dependents.clear();
+
+		QSet< QString > visited;
+
+		visit( rootFilePath, nullptr, visited );
+
+		for( auto it = files.begin(); it != files.end(); )
+		{
+			if( !visited.contains( it.key() ) )
+				it = files.erase( it );
+			else
+				++it;
+		}
+	}
+
+	//! Path of the root file.
+	QString rootFilePath;
+	//! Parsed files, forward edges of the graph are links of the files.
+	QMap< QString, LinkedFile > files;
+	//! Reverse edges of the graph.
+	QMap< QString, QSet< QString > > dependents;
+	//! Order of files in the combined document.
+	QStringList order;
+	//! Files reparsed or loaded by the last update.
+	QStringList updated;
+	//! Combined document of the last parse or update.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > combined;
+	//! First item and items count of each file in the combined document.
+	QMap< QString, std::pair< qsizetype, qsizetype > > ranges;
+	//! On-disk cache of parsed files.
+	ParseCache cache;
+}; // struct LinkedFilesPrivate
+
+
+//
+// LinkedFiles
+//
+
+LinkedFiles::LinkedFiles()
+	:	d( new LinkedFilesPrivate )
+{
+}
+
+LinkedFiles::~LinkedFiles()
+{
+}
+
+void
+LinkedFiles::setCacheDirectory( const QString & dir )
+{
+	d->cache.setDirectory( dir );
+}
+
+LinkedFile
+LinkedFiles::parseFile( const QString & path ) const
+{
+	// Each thread of the pool keeps its own parser with its buffers.
+	thread_local MD::Parser< MD::QStringTrait > parser;
+
+	LinkedFile file;
+	file.path = path;
+
+	QFile f( path );
+
+	if( !f.open( QIODevice::ReadOnly ) )
+		return file;
+
+	// File is read once, for the key and for parsing, so a file changed
+	// meanwhile won't match this entry next time.
+	const auto content = f.readAll();
+	f.close();
+
+	const auto key = ( d->cache.directory().isEmpty() ? ParseCacheKey() :
+		ParseCache::key( path, content ) );
+
+	if( d->cache.load( key, file ) )
+		return file;
+
+	QTextStream stream( content );
+
+	file.doc = parser.parse( stream, path );
+
+	if( file.doc )
+	{
+		for( const auto & item : file.doc->items() )
+			collectLinks( item.get(), file.links );
+
+		for( const auto & f : file.doc->footnotesMap() )
+			collectLinks( f.second.get(), file.links );
+
+		d->cache.store( key, file );
+	}
+
+	return file;
+}
+
+std::shared_ptr< MD::Document< MD::QStringTrait > >
+LinkedFiles::parse( const QString & rootFilePath )
+{
+	d->files.clear();
+	d->updated.clear();
+	d->rootFilePath = QFileInfo( rootFilePath ).absoluteFilePath();
+
+	d->load( this, { d->rootFilePath } );
+	d->reorder();
+
+	// Entries of renamed or removed files aren't needed anymore.
+	d->cache.prune();
+
+	return d->merge();
+}
+
+std::shared_ptr< MD::Document< MD::QStringTrait > >
+LinkedFiles::update( const QStringList & paths )
+{
+	QStringList changed;
+	QStringList missing;
+
+	d->updated.clear();
+
+	for( const auto & p : paths )
+	{
+		const auto path = QFileInfo( p ).absoluteFilePath();
+
+		if( !d->files.contains( path ) || changed.contains( path ) )
+			continue;
+
+		if( isMarkdownFile( path ) )
+			changed.append( path );
+		else
+		{
+			// Links to removed file are resolved differently now.
+			d->files.remove( path );
+
+			for( const auto & dep : d->dependents.value( path ) )
+			{
+				if( d->files.contains( dep ) && !changed.contains( dep ) )
+					changed.append( dep );
+			}
+		}
+	}
+
+	const auto previousOrder = d->order;
+	QMap< QString, std::shared_ptr< MD::Document< MD::QStringTrait > > > replaced;
+
+	const auto parsed = QtConcurrent::blockingMapped< QList< LinkedFile > > (
+		changed, [this]( const QString & path ) { return parseFile( path ); } );
+
+	for( const auto & file : parsed )
+	{
+		if( !file.doc )
+		{
+			d->files.remove( file.path );
+
+			continue;
+		}
+
+		replaced.insert( file.path, d->files.value( file.path ).doc );
+		d->files.insert( file.path, file );
+		d->updated.append( file.path );
+
+		if( file.doc->items().empty() )
+			continue;
+
+		for( const auto & link : file.links )
+		{
+			if( !d->files.contains( link ) && !missing.contains( link ) )
+				missing.append( link );
+		}
+	}
+
+	if( !missing.isEmpty() )
+		d->load( this, missing );
+
+	d->reorder();
+
+	return d->patch( previousOrder, replaced );
+}
+
+bool
+LinkedFiles::contains( const QString & path ) const
+{
+	return d->files.contains( QFileInfo( path ).absoluteFilePath() );
+}
+
+QStringList
+LinkedFiles::dependents( const QString & path ) const
+{
+	const auto deps = d->dependents.value( QFileInfo( path ).absoluteFilePath() );
+
+	return QStringList( deps.cbegin(), deps.cend() );
+}
+
+const QStringList &
+LinkedFiles::files() const
+{
+	return d->order;
+}
+
+const QStringList &
+LinkedFiles::updated() const
+{
+	return d->updated;
+}
+
+std::shared_ptr< MD::Document< MD::QStringTrait > >
+LinkedFiles::document( const QString & path ) const
+{
+	const auto it = d->files.constFind( QFileInfo( path ).absoluteFilePath() );
+
+	return ( it != d->files.cend() ? it->doc : nullptr );
+}
+
+} /* namespace MdEditor */
@@ -0,0 +1,105 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Qt include.
+#include <QString>
+#include <QStringList>
+#include <QScopedPointer>
+
+// md4qt include.
+#define MD4QT_QT_SUPPORT
+#include <md4qt/traits.hpp>
+#include <md4qt/parser.hpp>
+
+// C++ include.
+#include <memory>
+
+
+namespace MdEditor {
+
+//
+// LinkedFile
+//
+
+//! Parsed Markdown file of the linked files set.
+struct LinkedFile {
+	//! Absolute path of the file.
+	QString path;
+	//! Parsed document of this file only.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > doc;
+	//! Absolute paths of linked Markdown files in order of appearance.
+	QStringList links;
+}; // struct LinkedFile
+
+
+//
+// LinkedFiles
+//
+
+struct LinkedFilesPrivate;
+
+//! Loader of the root Markdown file and all linked Markdown files.
+//! Files are parsed in the global thread pool, resulting document is the
+//! same as MD::Parser produces in recursive mode. Parsed files are kept in
+//! the on-disk cache, so cold start parses only changed files. Object is
+//! not thread-safe, but may be used from any one thread at a time.
+class LinkedFiles final
+{
+public:
+	LinkedFiles();
+	~LinkedFiles();
+
+	//! Parse root file and all linked files.
+	//! \return Combined document.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > parse( const QString & rootFilePath );
+	//! Reparse only the given changed files. Newly linked files are loaded,
+	//! files that are not linked anymore are dropped, and files linking to
+	//! removed files are reparsed.
+	//! \return Combined document.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > update( const QStringList & paths );
+
+	//! \return Is the given file in the loaded set?
+	bool contains( const QString & path ) const;
+	//! \return Files that link to the given file.
+	QStringList dependents( const QString & path ) const;
+	//! \return Loaded files in order of the combined document.
+	const QStringList & files() const;
+	//! \return Files reparsed or loaded by the last update.
+	const QStringList & updated() const;
+	//! \return Parsed document of the given file only.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > document( const QString & path ) const;
+
+	//! Set directory of the on-disk parse cache, empty directory disables cache.
+	void setCacheDirectory( const QString & dir );
+
+	//! Parse one file without linked files, cached result is used if file
+	//! wasn't changed. Thread-safe.
+	LinkedFile parseFile( const QString & path ) const;
+
+private:
+	Q_DISABLE_COPY( LinkedFiles )
+
+	QScopedPointer< LinkedFilesPrivate > d;
+}; // class LinkedFiles
+
+} /* namespace MdEditor */
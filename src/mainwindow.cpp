@@ -33,6 +33,7 @@
 #include "cfg.hpp"
 #include "version.hpp"
 #include "colors.hpp"
+#include "linkedfiles.hpp"
 
 // Qt include.
 #include <QSplitter>
@@ -60,6 +61,11 @@
 #include <QLineEdit>
 #include <QLabel>
 #include <QTextBlock>
+#include <QFileSystemWatcher>
+#include <QDateTime>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
 
 // md4qt include.
 #define MD4QT_QT_SUPPORT
@@ -76,6 +82,100 @@
 
 namespace MdEditor {
 
+namespace /* anonymous */ {
+
+//! Result of the update of linked files made in background.
+struct LinkedFilesUpdate {
+	//! Generation of loaded linked files this update was started for.
+	unsigned long long int generation = 0;
+	//! Combined document.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > doc;
+	//! Files in order of the combined document.
+	QStringList order;
+	//! HTML of changed sections.
+	QMap< QString, QString > html;
+}; // struct LinkedFilesUpdate
+
+//
+// SectionHtmlVisitor
+//
+
+//! HTML visitor of one file of the combined document, that knows anchors of
+//! all files, so links to other files are resolved to their sections.
+class SectionHtmlVisitor final
+	:	public MD::details::HtmlVisitor< MD::QStringTrait >
+{
+public:
+	explicit SectionHtmlVisitor( const std::vector< QString > & anchors )
+		:	m_allAnchors( anchors )
+	{
+	}
+
+protected:
+	void onAnchor( MD::Anchor< MD::QStringTrait > * a ) override
+	{
+		MD::details::HtmlVisitor< MD::QStringTrait >::onAnchor( a );
+
+		// Anchor of the file is the first item, so all links of the file see
+		// anchors of all files.
+		m_anchors = m_allAnchors;
+	}
+
+private:
+	//! Anchors of all files.
+	const std::vector< QString > & m_allAnchors;
+}; // class SectionHtmlVisitor
+
+//! \return Anchors of files of the combined document.
+std::vector< QString >
+fileAnchors( std::shared_ptr< MD::Document< MD::QStringTrait > > combined )
+{
+	std::vector< QString > anchors;
+
+	for( const auto & item : combined->items() )
+	{
+		if( item->type() == MD::ItemType::Anchor )
+			anchors.push_back( static_cast< MD::Anchor< MD::QStringTrait >* > (
+				item.get() )->label() );
+	}
+
+	return anchors;
+}
+
+//! \return HTML of the section of preview for one file of the combined document.
+//! Footnotes, labeled links and labeled headings are taken from the combined
+//! document, so references between files are resolved, and footnotes
+//! referenced in the file are placed at the end of its section.
+QString
+sectionHtml( std::shared_ptr< MD::Document< MD::QStringTrait > > combined,
+	std::shared_ptr< MD::Document< MD::QStringTrait > > file,
+	const std::vector< QString > & anchors )
+{
+	if( !file )
+		return {};
+
+	auto doc = std::make_shared< MD::Document< MD::QStringTrait > > ();
+
+	for( const auto & item : file->items() )
+		doc->appendItem( item );
+
+	for( const auto & f : combined->footnotesMap() )
+		doc->insertFootnote( f.first, f.second );
+
+	for( const auto & l : combined->labeledLinks() )
+		doc->insertLabeledLink( l.first, l.second );
+
+	for( const auto & h : combined->labeledHeadings() )
+		doc->insertLabeledHeading( h.first, h.second );
+
+	SectionHtmlVisitor visitor( anchors );
+
+	return visitor.toHtml( doc, QStringLiteral( "qrc:/res/img/go-jump.png" ) );
+}
+
+} /* namespace anonymous */
+
+
 //
 // MainWindowPrivate
 //
@@ -255,6 +355,11 @@ struct MainWindowPrivate {
 		helpMenu->addAction( QIcon( QStringLiteral( ":/res/img/bookmarks-organize.png" ) ),
 				MainWindow::tr( "Licenses" ), q, &MainWindow::onShowLicenses );
 
+		largeDocumentLabel = new QLabel( MainWindow::tr( "Large document: highlighting is off, "
+			"preview is updated when idle" ), q );
+		largeDocumentLabel->hide();
+		q->statusBar()->addPermanentWidget( largeDocumentLabel );
+
 		cursorPosLabel = new QLabel( q );
 		q->statusBar()->addPermanentWidget( cursorPosLabel );
 
@@ -262,7 +367,9 @@ struct MainWindowPrivate {
 			saveAction, &QAction::setEnabled );
 		QObject::connect( editor->document(), &QTextDocument::modificationChanged,
 			q, &MainWindow::setWindowModified );
-		QObject::connect( editor, &QPlainTextEdit::textChanged, q, &MainWindow::onTextChanged );
+		QObject::connect( editor, &Editor::ready, q, &MainWindow::onTextChanged );
+		QObject::connect( editor, &Editor::largeDocumentModeChanged,
+			q, &MainWindow::onLargeDocumentModeChanged );
 		QObject::connect( editor, &Editor::lineHovered, q, &MainWindow::onLineHovered );
 		QObject::connect( toggleLineNumbersAction, &QAction::toggled,
 			editor, &Editor::showLineNumbers );
@@ -289,6 +396,19 @@ struct MainWindowPrivate {
 		QObject::connect( addTOCAction, &QAction::triggered,
 			q, &MainWindow::onAddTOC );
 
+		linkedWatcher = new QFileSystemWatcher( q );
+		linkedTimer = new QTimer( q );
+		linkedTimer->setSingleShot( true );
+		linkedTimer->setInterval( 300 );
+		linkedUpdate = new QFutureWatcher< LinkedFilesUpdate >( q );
+
+		QObject::connect( linkedWatcher, &QFileSystemWatcher::fileChanged,
+			q, &MainWindow::onLinkedFileChanged );
+		QObject::connect( linkedTimer, &QTimer::timeout,
+			q, &MainWindow::onUpdateLinkedFiles );
+		QObject::connect( linkedUpdate, &QFutureWatcher< LinkedFilesUpdate >::finished,
+			q, &MainWindow::onLinkedFilesUpdated );
+
 		q->readCfg();
 
 		q->onCursorPositionChanged();
@@ -330,6 +450,7 @@ struct MainWindowPrivate {
 	QDockWidget * fileTreeDock = nullptr;
 	QTreeWidget * fileTree = nullptr;
 	QLabel * cursorPosLabel = nullptr;
+	QLabel * largeDocumentLabel = nullptr;
 	bool init = false;
 	bool loadAllFlag = false;
 	bool previewMode = false;
@@ -338,6 +459,25 @@ struct MainWindowPrivate {
 	QString rootFilePath;
 	QString mdPdfExe;
 	Colors mdColors;
+	//! Loader of linked files.
+	LinkedFiles linkedFiles;
+	//! Watcher of linked files.
+	QFileSystemWatcher * linkedWatcher = nullptr;
+	//! Timer coalescing changes of linked files.
+	QTimer * linkedTimer = nullptr;
+	//! Update of linked files in background.
+	QFutureWatcher< LinkedFilesUpdate > * linkedUpdate = nullptr;
+	//! Changed linked files waiting for update.
+	QStringList changedLinked;
+	//! Modification time of linked files saved here, watcher's notifications
+	//! about these changes are ignored.
+	QMap< QString, QDateTime > savedLinked;
+	//! Generation of loaded linked files, updates of older generations are dropped.
+	unsigned long long int linkedGeneration = 0;
+	//! Files in order of preview's sections.
+	QStringList sectionsOrder;
+	//! HTML of preview's sections.
+	QMap< QString, QString > sectionsHtml;
 }; // struct MainWindowPrivate
 
 
@@ -353,6 +493,8 @@ MainWindow::MainWindow()
 
 MainWindow::~MainWindow()
 {
+	d->linkedUpdate->waitForFinished();
+
 	if( d->standardEditMenu )
 		d->standardEditMenu->deleteLater();
 
@@ -526,7 +668,16 @@ MainWindow::onFileSave()
 
 	updateWindowTitle();
 
-	readAllLinked();
+	if( d->loadAllFlag )
+	{
+		// Saved file is updated right now, not once again on watcher's notification.
+		const QFileInfo info( d->editor->docName() );
+		d->savedLinked.insert( info.absoluteFilePath(), info.lastModified() );
+
+		d->changedLinked.append( d->editor->docName() );
+
+		onUpdateLinkedFiles();
+	}
 }
 
 void
@@ -656,9 +807,9 @@ MainWindow::htmlContent() const
 		"    'fu' : '1f595'\n"
 		"  });\n"
 		"\n"
-		"  function replace_emoji() {\n"
-		"    let elementsToReplace = document.querySelectorAll('p, h1, h2, h3, h4, h5, h6, li, table');\n"
-		"    let elementsToIgnore = document.querySelectorAll('code');\n"
+		"  function replace_emoji(root) {\n"
+		"    let elementsToReplace = root.querySelectorAll('p, h1, h2, h3, h4, h5, h6, li, table');\n"
+		"    let elementsToIgnore = root.querySelectorAll('code');\n"
 		"    for (let i = 0; i < elementsToReplace.length; i++) {\n"
 		"      replace_emoji_in_node(elementsToReplace[i]);\n"
 		"    }\n"
@@ -677,27 +828,52 @@ MainWindow::htmlContent() const
 		"    }\n"
 		"  }\n"
 		"\n"
+		"  let postProcessing = true;\n"
+		"\n"
+		"  let render = function(root) {\n"
+		"     root.querySelectorAll('pre code').forEach((el) => {\n"
+		"         hljs.highlightElement(el);\n"
+		"     });\n"
+		"     if (postProcessing) {\n"
+		"         renderMathInElement(root, {\n"
+		"             delimiters: [\n"
+		"                 {left: '$$', right: '$$', display: true},\n"
+		"                 {left: '$', right: '$', display: false},\n"
+		"             ],\n"
+		"             throwOnError : false,\n"
+		"             strict : false,\n"
+		"             trust : true\n"
+		"         });\n"
+		"     }\n"
+		"     replaceBadges(root);\n"
+		"     if (postProcessing) {\n"
+		"         replace_emoji(root);\n"
+		"     }\n"
+		"  }\n"
+		"\n"
 		"  let updateText = function(text) {\n"
 		"     placeholder.innerHTML = text;\n"
-		"     hljs.highlightAll();\n"
-		"     renderMathInElement(document.body, {\n"
-		"         delimiters: [\n"
-		"             {left: '$$', right: '$$', display: true},\n"
-		"             {left: '$', right: '$', display: false},\n"
-		"         ],\n"
-		"         throwOnError : false,\n"
-		"         strict : false,\n"
-		"         trust : true\n"
-		"     });\n"
-		"     replaceBadges(placeholder);\n"
-		"     replace_emoji();\n"
+		"     render(placeholder);\n"
+		"  }\n"
+		"\n"
+		"  let updateSection = function(id, html) {\n"
+		"     let section = document.getElementById(id);\n"
+		"     if (section) {\n"
+		"         section.innerHTML = html;\n"
+		"         render(section);\n"
+		"     }\n"
 		"  }\n"
 		"\n"
 		"  new QWebChannel(qt.webChannelTransport,\n"
 		"	function(channel) {\n"
 		"	  let content = channel.objects.content;\n"
+		"	  postProcessing = content.postProcessing;\n"
+		"	  content.postProcessingChanged.connect(function(on) {\n"
+		"	    postProcessing = on;\n"
+		"	  });\n"
 		"	  updateText(content.text);\n"
 		"	  content.textChanged.connect(updateText);\n"
+		"	  content.sectionChanged.connect(updateSection);\n"
 		"	}\n"
 		"  );\n"
 		"  })();</script>\n"
@@ -708,7 +884,7 @@ MainWindow::htmlContent() const
 void
 MainWindow::onTextChanged()
 {
-	if( !d->loadAllFlag )
+	if( !d->loadAllFlag && d->editor->currentDoc() )
 	{
 		d->mdDoc = d->editor->currentDoc();
 
@@ -717,6 +893,13 @@ MainWindow::onTextChanged()
 	}
 }
 
+void
+MainWindow::onLargeDocumentModeChanged( bool on )
+{
+	d->largeDocumentLabel->setVisible( on );
+	d->html->setPostProcessing( !on );
+}
+
 void
 MainWindow::onAbout()
 {
@@ -912,6 +1095,7 @@ MainWindow::onChooseFont()
 
 static const QString c_appCfgFileName = QStringLiteral( "md-editor.cfg" );
 static const QString c_appCfgFolderName = QStringLiteral( "Markdown" );
+static const QString c_appCacheFolderName = QStringLiteral( "cache" );
 
 QString
 MainWindow::configFileName( bool inPlace ) const
@@ -957,6 +1141,7 @@ MainWindow::saveCfg() const
 			cfg.set_headingColor( d->mdColors.headingColor.name( QColor::HexRgb ) );
 			cfg.set_mathColor( d->mdColors.mathColor.name( QColor::HexRgb ) );
 			cfg.set_footnoteColor( d->mdColors.footnoteColor.name( QColor::HexRgb ) );
+			cfg.set_largeDocumentBudget( d->editor->timeBudget() );
 
 			tag_Cfg< cfgfile::qstring_trait_t > tag( cfg );
 
@@ -976,6 +1161,9 @@ MainWindow::saveCfg() const
 void
 MainWindow::readCfg()
 {
+	d->linkedFiles.setCacheDirectory( QFileInfo( configFileName( false ) ).absolutePath() +
+		QDir::separator() + c_appCacheFolderName );
+
 	auto fileName = configFileName( false );
 	
 	if( !QFileInfo::exists( fileName ) )
@@ -1037,6 +1225,9 @@ MainWindow::readCfg()
 				d->mdColors.footnoteColor = QColor( cfg.footnoteColor() );
 
 			d->mdColors.enabled = cfg.useColors();
+
+			if( cfg.largeDocumentBudget() > 0 )
+				d->editor->setTimeBudget( cfg.largeDocumentBudget() );
 		}
 		catch( const cfgfile::exception_t< cfgfile::qstring_trait_t > & )
 		{
@@ -1242,7 +1433,7 @@ MainWindow::loadAllLinkedFiles( bool doNotCloseDock )
 				addDockWidget( Qt::LeftDockWidgetArea, d->fileTreeDock );
 
 				QMessageBox::information( this, windowTitle(),
-					tr( "HTML preview is ready. Modifications in files will not update "
+					tr( "HTML preview is ready. Modifications in the editor will not update "
 						"HTML preview till you save changes." ) );
 			}
 		}
@@ -1266,6 +1457,15 @@ MainWindow::closeAllLinkedFiles()
 {
 	d->loadAllFlag = false;
 
+	stopLinkedFilesUpdate();
+
+	if( !d->linkedWatcher->files().isEmpty() )
+		d->linkedWatcher->removePaths( d->linkedWatcher->files() );
+
+	d->sectionsOrder.clear();
+	d->sectionsHtml.clear();
+	d->savedLinked.clear();
+
 	if( d->fileTreeDock )
 	{
 		removeDockWidget( d->fileTreeDock );
@@ -1285,14 +1485,191 @@ MainWindow::readAllLinked()
 {
 	if( d->loadAllFlag )
 	{
-		MD::Parser< MD::QStringTrait > parser;
+		stopLinkedFilesUpdate();
 
-		d->mdDoc = parser.parse( d->rootFilePath, true,
-			{ QStringLiteral( "md" ), QStringLiteral( "mkd" ), QStringLiteral( "markdown" ) } );
+		d->mdDoc = d->linkedFiles.parse( d->rootFilePath );
+		d->sectionsOrder = d->linkedFiles.files();
 
-		d->html->setText( MD::toHtml( d->mdDoc, false,
-			QStringLiteral( "qrc:/res/img/go-jump.png" ) ) );
+		const auto anchors = fileAnchors( d->mdDoc );
+
+		const auto sections = QtConcurrent::blockingMapped< QStringList > ( d->sectionsOrder,
+			[this, &anchors]( const QString & path )
+				{ return sectionHtml( d->mdDoc, d->linkedFiles.document( path ), anchors ); } );
+
+		d->sectionsHtml.clear();
+
+		for( qsizetype i = 0; i < d->sectionsOrder.size(); ++i )
+			d->sectionsHtml.insert( d->sectionsOrder.at( i ), sections.at( i ) );
+
+		d->html->setSections( sections );
+
+		watchLinkedFiles();
+	}
+}
+
+void
+MainWindow::stopLinkedFilesUpdate()
+{
+	++d->linkedGeneration;
+
+	d->linkedTimer->stop();
+	d->changedLinked.clear();
+	d->linkedUpdate->waitForFinished();
+}
+
+void
+MainWindow::watchLinkedFiles()
+{
+	const auto & files = d->linkedFiles.files();
+	const auto watched = d->linkedWatcher->files();
+
+	QStringList toRemove;
+
+	for( const auto & path : watched )
+	{
+		if( !files.contains( path ) )
+			toRemove.append( path );
+	}
+
+	if( !toRemove.isEmpty() )
+		d->linkedWatcher->removePaths( toRemove );
+
+	QStringList toAdd;
+
+	for( const auto & path : files )
+	{
+		if( !watched.contains( path ) )
+			toAdd.append( path );
+	}
+
+	if( !toAdd.isEmpty() )
+		d->linkedWatcher->addPaths( toAdd );
+}
+
+void
+MainWindow::onLinkedFileChanged( const QString & path )
+{
+	if( !d->loadAllFlag )
+		return;
+
+	auto saved = d->savedLinked.find( path );
+
+	if( saved != d->savedLinked.end() )
+	{
+		if( QFileInfo( path ).lastModified() == saved.value() )
+			return;
+
+		d->savedLinked.erase( saved );
+	}
+
+	if( !d->changedLinked.contains( path ) )
+		d->changedLinked.append( path );
+
+	// Generators rewrite a lot of files at once, so changes are coalesced.
+	d->linkedTimer->start();
+}
+
+void
+MainWindow::onUpdateLinkedFiles()
+{
+	// Next update will be started when running one is done.
+	if( !d->loadAllFlag || d->changedLinked.isEmpty() || d->linkedUpdate->isRunning() )
+		return;
+
+	d->linkedTimer->stop();
+
+	const auto paths = std::exchange( d->changedLinked, {} );
+	const auto keys = d->sectionsHtml.keys();
+	const QSet< QString > known( keys.cbegin(), keys.cend() );
+	const auto generation = d->linkedGeneration;
+
+	d->linkedUpdate->setFuture( QtConcurrent::run(
+		[this, paths, known, generation]()
+		{
+			LinkedFilesUpdate update;
+			update.generation = generation;
+			update.doc = d->linkedFiles.update( paths );
+			update.order = d->linkedFiles.files();
+
+			// Only sections of reparsed files, of files linking to them, and
+			// of new files are rendered.
+			QStringList render;
+
+			const auto & updated = d->linkedFiles.updated();
+
+			for( const auto & path : std::as_const( update.order ) )
+			{
+				if( !known.contains( path ) || updated.contains( path ) )
+					render.append( path );
+			}
+
+			for( const auto & path : updated )
+			{
+				for( const auto & dep : d->linkedFiles.dependents( path ) )
+				{
+					if( d->linkedFiles.contains( dep ) && !render.contains( dep ) )
+						render.append( dep );
+				}
+			}
+
+			const auto anchors = fileAnchors( update.doc );
+
+			const auto sections = QtConcurrent::blockingMapped< QStringList > ( render,
+				[this, &update, &anchors]( const QString & path )
+					{ return sectionHtml( update.doc, d->linkedFiles.document( path ), anchors ); } );
+
+			for( qsizetype i = 0; i < render.size(); ++i )
+				update.html.insert( render.at( i ), sections.at( i ) );
+
+			return update;
+		} ) );
+}
+
+void
+MainWindow::onLinkedFilesUpdated()
+{
+	const auto update = d->linkedUpdate->result();
+
+	if( update.generation != d->linkedGeneration || !d->loadAllFlag )
+		return;
+
+	d->mdDoc = update.doc;
+
+	for( auto it = update.html.cbegin(), last = update.html.cend(); it != last; ++it )
+		d->sectionsHtml.insert( it.key(), it.value() );
+
+	if( update.order == d->sectionsOrder && d->html->sectionsCount() == update.order.size() )
+	{
+		for( auto it = update.html.cbegin(), last = update.html.cend(); it != last; ++it )
+			d->html->setSection( d->sectionsOrder.indexOf( it.key() ), it.value() );
 	}
+	else
+	{
+		const QSet< QString > order( update.order.cbegin(), update.order.cend() );
+
+		for( auto it = d->sectionsHtml.begin(); it != d->sectionsHtml.end(); )
+		{
+			if( !order.contains( it.key() ) )
+				it = d->sectionsHtml.erase( it );
+			else
+				++it;
+		}
+
+		d->sectionsOrder = update.order;
+
+		QStringList sections;
+		sections.reserve( d->sectionsOrder.size() );
+
+		for( const auto & path : std::as_const( d->sectionsOrder ) )
+			sections.append( d->sectionsHtml.value( path ) );
+
+		d->html->setSections( sections );
+	}
+
+	watchLinkedFiles();
+
+	if( !d->changedLinked.isEmpty() )
+		d->linkedTimer->start();
 }
 
 void
@@ -1459,12 +1836,18 @@ simplifyLabel( const QString & label, const QString & fileName )
 void
 MainWindow::onAddTOC()
 {
+	// Headings just typed should be in TOC, so pending text is parsed now.
+	const auto doc = ( d->loadAllFlag ? d->mdDoc : d->editor->parseNow() );
+
+	if( !doc )
+		return;
+
 	QString toc;
 	int lvl = 0;
 	int offset = 0;
 	QString fileName;
 
-	for( auto it = d->mdDoc->items().cbegin(), last = d->mdDoc->items().cend();
+	for( auto it = doc->items().cbegin(), last = doc->items().cend();
 		it != last; ++it )
 	{
 		if( (*it)->type() == MD::ItemType::Anchor )
@@ -83,6 +83,10 @@ private slots:
 	void onConvertToPdf();
 	void onAddTOC();
 	void onChangeColors();
+	void onLinkedFileChanged( const QString & path );
+	void onUpdateLinkedFiles();
+	void onLinkedFilesUpdated();
+	void onLargeDocumentModeChanged( bool on );
 
 private:
     bool isModified() const;
@@ -90,6 +94,8 @@ private:
 	void saveCfg() const;
 	void readCfg();
 	void readAllLinked();
+	void stopLinkedFilesUpdate();
+	void watchLinkedFiles();
 	void updateWindowTitle();
 	void updateLoadAllLinkedFilesMenuText();
 	void closeAllLinkedFiles();
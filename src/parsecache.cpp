@@ -0,0 +1,759 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-editor include.
+#include "parsecache.hpp"
+#include "linkedfiles.hpp"
+#include "parsingthread.hpp"
+#include "version.hpp"
+
+// Qt include.
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QCryptographicHash>
+
+// md4qt include.
+#include <md4qt/html.hpp>
+
+
+namespace MdEditor {
+
+namespace /* anonymous */ {
+
+//! Magic number of cache entry.
+static const quint32 c_cacheMagic = 0x4D444543;
+//! Version of the format of cache entry. Increment on any change in serialization.
+static const qint32 c_cacheFormatVersion = 2;
+
+
+//
+// Writing.
+//
+
+void writeItem( QDataStream & s, MD::Item< MD::QStringTrait > * item );
+
+void
+writeBlock( QDataStream & s, MD::Block< MD::QStringTrait > * b )
+{
+	s << static_cast< qint64 > ( b->items().size() );
+
+	for( const auto & i : b->items() )
+		writeItem( s, i.get() );
+}
+
+template< class T >
+void
+writeOptional( QDataStream & s, const std::shared_ptr< T > & i )
+{
+	s << static_cast< bool > ( i );
+
+	if( i )
+		writeItem( s, i.get() );
+}
+
+void
+writeItem( QDataStream & s, MD::Item< MD::QStringTrait > * item )
+{
+	s << static_cast< qint32 > ( item->type() )
+		<< static_cast< qint64 > ( item->startLine() )
+		<< static_cast< qint64 > ( item->startColumn() )
+		<< static_cast< qint64 > ( item->endLine() )
+		<< static_cast< qint64 > ( item->endColumn() );
+
+	switch( item->type() )
+	{
+		case MD::ItemType::Heading :
+		{
+			auto h = static_cast< MD::Heading< MD::QStringTrait >* > ( item );
+			s << static_cast< qint32 > ( h->level() ) << h->label();
+			writeOptional( s, h->text() );
+		}
+			break;
+
+		case MD::ItemType::Text :
+		{
+			auto t = static_cast< MD::Text< MD::QStringTrait >* > ( item );
+			s << t->text() << static_cast< qint32 > ( t->opts() )
+				<< t->isSpaceBefore() << t->isSpaceAfter();
+		}
+			break;
+
+		case MD::ItemType::Paragraph :
+		case MD::ItemType::Blockquote :
+		case MD::ItemType::List :
+		case MD::ItemType::TableCell :
+		case MD::ItemType::Footnote :
+			writeBlock( s, static_cast< MD::Block< MD::QStringTrait >* > ( item ) );
+			break;
+
+		case MD::ItemType::ListItem :
+		{
+			auto l = static_cast< MD::ListItem< MD::QStringTrait >* > ( item );
+			s << static_cast< qint32 > ( l->listType() )
+				<< static_cast< qint32 > ( l->orderedListPreState() )
+				<< static_cast< qint32 > ( l->startNumber() )
+				<< l->isTaskList() << l->isChecked();
+			writeBlock( s, l );
+		}
+			break;
+
+		case MD::ItemType::Link :
+		{
+			auto l = static_cast< MD::Link< MD::QStringTrait >* > ( item );
+			s << l->url() << l->text() << static_cast< qint32 > ( l->opts() );
+			writeOptional( s, l->p() );
+			writeOptional( s, l->img() );
+		}
+			break;
+
+		case MD::ItemType::Image :
+		{
+			auto i = static_cast< MD::Image< MD::QStringTrait >* > ( item );
+			s << i->url() << i->text();
+			writeOptional( s, i->p() );
+		}
+			break;
+
+		case MD::ItemType::Code :
+		{
+			auto c = static_cast< MD::Code< MD::QStringTrait >* > ( item );
+			s << c->text() << c->isFensedCode() << c->isInlined() << c->syntax()
+				<< static_cast< qint32 > ( c->opts() );
+		}
+			break;
+
+		case MD::ItemType::Table :
+		{
+			auto t = static_cast< MD::Table< MD::QStringTrait >* > ( item );
+			s << static_cast< qint32 > ( t->columnsCount() );
+
+			for( int i = 0; i < t->columnsCount(); ++i )
+				s << static_cast< qint32 > ( t->columnAlignment( i ) );
+
+			s << static_cast< qint64 > ( t->rows().size() );
+
+			for( const auto & r : t->rows() )
+				writeItem( s, r.get() );
+		}
+			break;
+
+		case MD::ItemType::TableRow :
+		{
+			auto r = static_cast< MD::TableRow< MD::QStringTrait >* > ( item );
+			s << static_cast< qint64 > ( r->cells().size() );
+
+			for( const auto & c : r->cells() )
+				writeItem( s, c.get() );
+		}
+			break;
+
+		case MD::ItemType::FootnoteRef :
+		{
+			auto f = static_cast< MD::FootnoteRef< MD::QStringTrait >* > ( item );
+			s << f->id() << static_cast< qint32 > ( f->opts() );
+		}
+			break;
+
+		case MD::ItemType::Anchor :
+			s << static_cast< MD::Anchor< MD::QStringTrait >* > ( item )->label();
+			break;
+
+		case MD::ItemType::RawHtml :
+			s << static_cast< MD::RawHtml< MD::QStringTrait >* > ( item )->text();
+			break;
+
+		case MD::ItemType::Math :
+		{
+			auto m = static_cast< MD::Math< MD::QStringTrait >* > ( item );
+			s << m->expr() << m->isInline();
+		}
+			break;
+
+		case MD::ItemType::LineBreak :
+		case MD::ItemType::HorizontalLine :
+		case MD::ItemType::PageBreak :
+			break;
+
+		// Entry can't be restored, so it's not stored at all.
+		default :
+			s.setStatus( QDataStream::WriteFailed );
+			break;
+	}
+}
+
+void
+writeDocument( QDataStream & s, MD::Document< MD::QStringTrait > * doc )
+{
+	writeBlock( s, doc );
+
+	s << static_cast< qint64 > ( doc->footnotesMap().size() );
+
+	for( const auto & f : doc->footnotesMap() )
+	{
+		s << f.first;
+		writeItem( s, f.second.get() );
+	}
+
+	s << static_cast< qint64 > ( doc->labeledLinks().size() );
+
+	for( const auto & l : doc->labeledLinks() )
+	{
+		s << l.first;
+		writeItem( s, l.second.get() );
+	}
+}
+
+
+//
+// Reading.
+//
+
+std::shared_ptr< MD::Item< MD::QStringTrait > > readItem( QDataStream & s );
+
+template< class T >
+std::shared_ptr< T >
+readItemOfType( QDataStream & s, MD::ItemType type )
+{
+	auto i = readItem( s );
+
+	if( i && i->type() == type )
+		return std::static_pointer_cast< T > ( i );
+
+	s.setStatus( QDataStream::ReadCorruptData );
+
+	return {};
+}
+
+template< class T >
+std::shared_ptr< T >
+readOptional( QDataStream & s, MD::ItemType type )
+{
+	bool exists = false;
+	s >> exists;
+
+	if( exists )
+		return readItemOfType< T > ( s, type );
+
+	return {};
+}
+
+bool
+readBlock( QDataStream & s, MD::Block< MD::QStringTrait > * b )
+{
+	qint64 count = 0;
+	s >> count;
+
+	for( qint64 i = 0; i < count && s.status() == QDataStream::Ok; ++i )
+	{
+		auto item = readItem( s );
+
+		if( !item )
+			return false;
+
+		b->appendItem( item );
+	}
+
+	return ( s.status() == QDataStream::Ok );
+}
+
+std::shared_ptr< MD::Item< MD::QStringTrait > >
+readItem( QDataStream & s )
+{
+	qint32 type = 0;
+	qint64 startLine = 0, startColumn = 0, endLine = 0, endColumn = 0;
+
+	s >> type >> startLine >> startColumn >> endLine >> endColumn;
+
+	if( s.status() != QDataStream::Ok )
+		return {};
+
+	std::shared_ptr< MD::Item< MD::QStringTrait > > item;
+
+	switch( static_cast< MD::ItemType > ( type ) )
+	{
+		case MD::ItemType::Heading :
+		{
+			auto h = std::make_shared< MD::Heading< MD::QStringTrait > > ();
+			qint32 level = 0;
+			QString label;
+			s >> level >> label;
+			h->setLevel( level );
+			h->setLabel( label );
+			h->setText( readOptional< MD::Paragraph< MD::QStringTrait > > ( s,
+				MD::ItemType::Paragraph ) );
+			item = h;
+		}
+			break;
+
+		case MD::ItemType::Text :
+		{
+			auto t = std::make_shared< MD::Text< MD::QStringTrait > > ();
+			QString text;
+			qint32 opts = 0;
+			bool spaceBefore = false, spaceAfter = false;
+			s >> text >> opts >> spaceBefore >> spaceAfter;
+			t->setText( text );
+			t->setOpts( opts );
+			t->setSpaceBefore( spaceBefore );
+			t->setSpaceAfter( spaceAfter );
+			item = t;
+		}
+			break;
+
+		case MD::ItemType::Paragraph :
+		{
+			auto p = std::make_shared< MD::Paragraph< MD::QStringTrait > > ();
+			readBlock( s, p.get() );
+			item = p;
+		}
+			break;
+
+		case MD::ItemType::Blockquote :
+		{
+			auto b = std::make_shared< MD::Blockquote< MD::QStringTrait > > ();
+			readBlock( s, b.get() );
+			item = b;
+		}
+			break;
+
+		case MD::ItemType::List :
+		{
+			auto l = std::make_shared< MD::List< MD::QStringTrait > > ();
+			readBlock( s, l.get() );
+			item = l;
+		}
+			break;
+
+		case MD::ItemType::TableCell :
+		{
+			auto c = std::make_shared< MD::TableCell< MD::QStringTrait > > ();
+			readBlock( s, c.get() );
+			item = c;
+		}
+			break;
+
+		case MD::ItemType::Footnote :
+		{
+			auto f = std::make_shared< MD::Footnote< MD::QStringTrait > > ();
+			readBlock( s, f.get() );
+			item = f;
+		}
+			break;
+
+		case MD::ItemType::ListItem :
+		{
+			auto l = std::make_shared< MD::ListItem< MD::QStringTrait > > ();
+			qint32 listType = 0, preState = 0, startNumber = 0;
+			bool taskList = false, checked = false;
+			s >> listType >> preState >> startNumber >> taskList >> checked;
+			l->setListType( static_cast< MD::ListItem< MD::QStringTrait >::ListType > ( listType ) );
+			l->setOrderedListPreState(
+				static_cast< MD::ListItem< MD::QStringTrait >::OrderedListPreState > ( preState ) );
+			l->setStartNumber( startNumber );
+			l->setTaskList( taskList );
+			l->setChecked( checked );
+			readBlock( s, l.get() );
+			item = l;
+		}
+			break;
+
+		case MD::ItemType::Link :
+		{
+			auto l = std::make_shared< MD::Link< MD::QStringTrait > > ();
+			QString url, text;
+			qint32 opts = 0;
+			s >> url >> text >> opts;
+			l->setUrl( url );
+			l->setText( text );
+			l->setOpts( opts );
+			l->setP( readOptional< MD::Paragraph< MD::QStringTrait > > ( s,
+				MD::ItemType::Paragraph ) );
+			l->setImg( readOptional< MD::Image< MD::QStringTrait > > ( s,
+				MD::ItemType::Image ) );
+			item = l;
+		}
+			break;
+
+		case MD::ItemType::Image :
+		{
+			auto i = std::make_shared< MD::Image< MD::QStringTrait > > ();
+			QString url, text;
+			s >> url >> text;
+			i->setUrl( url );
+			i->setText( text );
+			i->setP( readOptional< MD::Paragraph< MD::QStringTrait > > ( s,
+				MD::ItemType::Paragraph ) );
+			item = i;
+		}
+			break;
+
+		case MD::ItemType::Code :
+		{
+			QString text, syntax;
+			bool fensed = false, inlined = false;
+			qint32 opts = 0;
+			s >> text >> fensed >> inlined >> syntax >> opts;
+			auto c = std::make_shared< MD::Code< MD::QStringTrait > > ( text, fensed, inlined );
+			c->setSyntax( syntax );
+			c->setOpts( opts );
+			item = c;
+		}
+			break;
+
+		case MD::ItemType::Table :
+		{
+			auto t = std::make_shared< MD::Table< MD::QStringTrait > > ();
+			qint32 columns = 0;
+			s >> columns;
+
+			for( qint32 i = 0; i < columns; ++i )
+			{
+				qint32 a = 0;
+				s >> a;
+				t->setColumnAlignment( i,
+					static_cast< MD::Table< MD::QStringTrait >::Alignment > ( a ) );
+			}
+
+			qint64 rows = 0;
+			s >> rows;
+
+			for( qint64 i = 0; i < rows && s.status() == QDataStream::Ok; ++i )
+			{
+				auto r = readItemOfType< MD::TableRow< MD::QStringTrait > > ( s,
+					MD::ItemType::TableRow );
+
+				if( r )
+					t->appendRow( r );
+			}
+
+			item = t;
+		}
+			break;
+
+		case MD::ItemType::TableRow :
+		{
+			auto r = std::make_shared< MD::TableRow< MD::QStringTrait > > ();
+			qint64 cells = 0;
+			s >> cells;
+
+			for( qint64 i = 0; i < cells && s.status() == QDataStream::Ok; ++i )
+			{
+				auto c = readItemOfType< MD::TableCell< MD::QStringTrait > > ( s,
+					MD::ItemType::TableCell );
+
+				if( c )
+					r->appendCell( c );
+			}
+
+			item = r;
+		}
+			break;
+
+		case MD::ItemType::FootnoteRef :
+		{
+			QString id;
+			qint32 opts = 0;
+			s >> id >> opts;
+			auto f = std::make_shared< MD::FootnoteRef< MD::QStringTrait > > ( id );
+			f->setOpts( opts );
+			item = f;
+		}
+			break;
+
+		case MD::ItemType::Anchor :
+		{
+			QString label;
+			s >> label;
+			item = std::make_shared< MD::Anchor< MD::QStringTrait > > ( label );
+		}
+			break;
+
+		case MD::ItemType::RawHtml :
+		{
+			auto h = std::make_shared< MD::RawHtml< MD::QStringTrait > > ();
+			QString text;
+			s >> text;
+			h->setText( text );
+			item = h;
+		}
+			break;
+
+		case MD::ItemType::Math :
+		{
+			auto m = std::make_shared< MD::Math< MD::QStringTrait > > ();
+			QString expr;
+			bool inlined = false;
+			s >> expr >> inlined;
+			m->setExpr( expr );
+			m->setInline( inlined );
+			item = m;
+		}
+			break;
+
+		case MD::ItemType::LineBreak :
+			item = std::make_shared< MD::LineBreak< MD::QStringTrait > > ();
+			break;
+
+		case MD::ItemType::HorizontalLine :
+			item = std::make_shared< MD::HorizontalLine< MD::QStringTrait > > ();
+			break;
+
+		case MD::ItemType::PageBreak :
+			item = std::make_shared< MD::PageBreak< MD::QStringTrait > > ();
+			break;
+
+		default :
+			s.setStatus( QDataStream::ReadCorruptData );
+			return {};
+	}
+
+	if( s.status() != QDataStream::Ok )
+		return {};
+
+	item->setStartLine( startLine );
+	item->setStartColumn( startColumn );
+	item->setEndLine( endLine );
+	item->setEndColumn( endColumn );
+
+	return item;
+}
+
+std::shared_ptr< MD::Document< MD::QStringTrait > >
+readDocument( QDataStream & s )
+{
+	auto doc = std::make_shared< MD::Document< MD::QStringTrait > > ();
+
+	if( !readBlock( s, doc.get() ) )
+		return {};
+
+	// Labeled headings are the same objects as headings in the document,
+	// so they are not stored but restored from the headings.
+	restoreLabeledHeadings( doc.get(), doc.get() );
+
+	qint64 count = 0;
+	s >> count;
+
+	for( qint64 i = 0; i < count && s.status() == QDataStream::Ok; ++i )
+	{
+		QString id;
+		s >> id;
+
+		auto f = readItemOfType< MD::Footnote< MD::QStringTrait > > ( s,
+			MD::ItemType::Footnote );
+
+		if( f )
+			doc->insertFootnote( id, f );
+	}
+
+	s >> count;
+
+	for( qint64 i = 0; i < count && s.status() == QDataStream::Ok; ++i )
+	{
+		QString label;
+		s >> label;
+
+		auto l = readItemOfType< MD::Link< MD::QStringTrait > > ( s, MD::ItemType::Link );
+
+		if( l )
+			doc->insertLabeledLink( label, l );
+	}
+
+	if( s.status() != QDataStream::Ok )
+		return {};
+
+	return doc;
+}
+
+} /* namespace anonymous */
+
+
+//
+// ParseCache
+//
+
+void
+ParseCache::setDirectory( const QString & dir )
+{
+	m_dir = dir;
+
+	if( !m_dir.isEmpty() && !QDir().mkpath( m_dir ) )
+		m_dir.clear();
+}
+
+const QString &
+ParseCache::directory() const
+{
+	return m_dir;
+}
+
+ParseCacheKey
+ParseCache::key( const QString & path, const QByteArray & content )
+{
+	ParseCacheKey key;
+
+	const QFileInfo info( path );
+
+	key.path = info.canonicalFilePath();
+	key.modified = info.lastModified().toMSecsSinceEpoch();
+	key.size = content.size();
+	key.hash = QCryptographicHash::hash( content, QCryptographicHash::Sha1 );
+
+	return key;
+}
+
+QString
+ParseCache::entryFileName( const ParseCacheKey & key ) const
+{
+	return m_dir + QStringLiteral( "/" ) +
+		QString::fromLatin1( QCryptographicHash::hash( key.path.toUtf8(),
+			QCryptographicHash::Sha1 ).toHex() ) + QStringLiteral( ".mdcache" );
+}
+
+bool
+ParseCache::load( const ParseCacheKey & key, LinkedFile & file ) const
+{
+	if( m_dir.isEmpty() || !key.isValid() )
+		return false;
+
+	const auto fileName = entryFileName( key );
+
+	QFile f( fileName );
+
+	if( !f.open( QIODevice::ReadOnly ) )
+		return false;
+
+	{
+		QMutexLocker lock( &m_mutex );
+		m_used.insert( QFileInfo( fileName ).fileName() );
+	}
+
+	QDataStream s( &f );
+	s.setVersion( QDataStream::Qt_6_0 );
+
+	quint32 magic = 0;
+	qint32 version = 0;
+	QString md4qtVersion, path;
+	qint64 modified = 0, size = 0;
+	QByteArray hash;
+
+	s >> magic >> version >> md4qtVersion >> path >> modified >> size >> hash;
+
+	if( s.status() != QDataStream::Ok || magic != c_cacheMagic ||
+		version != c_cacheFormatVersion || md4qtVersion != c_md4qtVersion ||
+		path != key.path || modified != key.modified || size != key.size ||
+		hash != key.hash )
+	{
+		return false;
+	}
+
+	QStringList links;
+	s >> links;
+
+	auto doc = readDocument( s );
+
+	if( !doc )
+		return false;
+
+	file.doc = doc;
+	file.links = links;
+
+	return true;
+}
+
+void
+ParseCache::store( const ParseCacheKey & key, const LinkedFile & file ) const
+{
+	if( m_dir.isEmpty() || !key.isValid() || !file.doc )
+		return;
+
+	QByteArray data;
+
+	{
+		QDataStream s( &data, QIODevice::WriteOnly );
+		s.setVersion( QDataStream::Qt_6_0 );
+
+		writeDocument( s, file.doc.get() );
+
+		if( s.status() != QDataStream::Ok )
+			return;
+	}
+
+#ifndef QT_NO_DEBUG
+	// Loaded document should render exactly like the parsed one.
+	{
+		QDataStream s( data );
+		s.setVersion( QDataStream::Qt_6_0 );
+
+		const auto doc = readDocument( s );
+
+		if( !doc || MD::toHtml( doc ) != MD::toHtml( file.doc ) )
+			return;
+	}
+#endif
+
+	const auto fileName = entryFileName( key );
+
+	QSaveFile f( fileName );
+
+	if( !f.open( QIODevice::WriteOnly ) )
+		return;
+
+	{
+		QMutexLocker lock( &m_mutex );
+		m_used.insert( QFileInfo( fileName ).fileName() );
+	}
+
+	QDataStream s( &f );
+	s.setVersion( QDataStream::Qt_6_0 );
+
+	s << c_cacheMagic << c_cacheFormatVersion << c_md4qtVersion
+		<< key.path << key.modified << key.size << key.hash << file.links;
+
+	if( s.status() == QDataStream::Ok && f.write( data ) == data.size() )
+		f.commit();
+	else
+		f.cancelWriting();
+}
+
+void
+ParseCache::prune()
+{
+	if( m_dir.isEmpty() )
+		return;
+
+	QMutexLocker lock( &m_mutex );
+
+	const auto entries = QDir( m_dir ).entryList( { QStringLiteral( "*.mdcache" ) }, QDir::Files );
+
+	for( const auto & entry : entries )
+	{
+		if( !m_used.contains( entry ) )
+			QFile::remove( m_dir + QStringLiteral( "/" ) + entry );
+	}
+
+	m_used.clear();
+}
+
+} /* namespace MdEditor */
@@ -0,0 +1,102 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Qt include.
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QSet>
+
+
+namespace MdEditor {
+
+struct LinkedFile;
+
+//
+// ParseCacheKey
+//
+
+//! Identity of the file's content.
+struct ParseCacheKey {
+	//! Canonical path of the file.
+	QString path;
+	//! Last modification time, in milliseconds since epoch.
+	qint64 modified = 0;
+	//! Size of the file.
+	qint64 size = 0;
+	//! Hash of the content.
+	QByteArray hash;
+
+	bool isValid() const
+	{
+		return !path.isEmpty();
+	}
+}; // struct ParseCacheKey
+
+
+//
+// ParseCache
+//
+
+//! On-disk cache of parsed Markdown files. Each file is stored in a
+//! compact binary form stamped with the format version and md4qt version.
+//! Only what is needed to render and navigate linked files is stored: items
+//! with their text, options and lines, footnotes, labeled links and labels of
+//! headings. Positions of delimiters, link's text and URL, and so on are not
+//! stored, so loaded documents are not suitable for syntax highlighting.
+//! Documents with unknown items are not stored. Methods are thread-safe.
+class ParseCache final
+{
+public:
+	ParseCache() = default;
+
+	//! Set cache directory, empty directory disables cache.
+	void setDirectory( const QString & dir );
+	//! \return Cache directory.
+	const QString & directory() const;
+
+	//! \return Key of the given file with the given content.
+	static ParseCacheKey key( const QString & path, const QByteArray & content );
+
+	//! Load cached file.
+	//! \return false if there is no valid entry for the key.
+	bool load( const ParseCacheKey & key, LinkedFile & file ) const;
+	//! Store parsed file.
+	void store( const ParseCacheKey & key, const LinkedFile & file ) const;
+	//! Remove entries that were neither loaded nor stored since the last pruning.
+	void prune();
+
+private:
+	//! \return Name of the file of cache entry.
+	QString entryFileName( const ParseCacheKey & key ) const;
+
+private:
+	//! Cache directory.
+	QString m_dir;
+	//! Guard of used entries.
+	mutable QMutex m_mutex;
+	//! Names of entries used since the last pruning.
+	mutable QSet< QString > m_used;
+}; // class ParseCache
+
+} /* namespace MdEditor */
@@ -0,0 +1,481 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-editor include.
+#include "parsingthread.hpp"
+
+// Qt include.
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QTextStream>
+
+
+namespace MdEditor {
+
+void
+shiftItemLines( MD::Item< MD::QStringTrait > * item, long long int delta )
+{
+	if( !item || !delta )
+		return;
+
+	if( item->startLine() >= 0 )
+	{
+		item->setStartLine( item->startLine() + delta );
+		item->setEndLine( item->endLine() + delta );
+	}
+
+	switch( item->type() )
+	{
+		case MD::ItemType::Heading :
+		{
+			auto h = static_cast< MD::Heading< MD::QStringTrait >* > ( item );
+
+			if( h->text() )
+				shiftItemLines( h->text().get(), delta );
+		}
+			break;
+
+		case MD::ItemType::Paragraph :
+		case MD::ItemType::Blockquote :
+		case MD::ItemType::List :
+		case MD::ItemType::ListItem :
+		case MD::ItemType::TableCell :
+		case MD::ItemType::Footnote :
+		{
+			auto b = static_cast< MD::Block< MD::QStringTrait >* > ( item );
+
+			for( const auto & i : b->items() )
+				shiftItemLines( i.get(), delta );
+		}
+			break;
+
+		case MD::ItemType::Table :
+		{
+			auto t = static_cast< MD::Table< MD::QStringTrait >* > ( item );
+
+			for( const auto & r : t->rows() )
+				shiftItemLines( r.get(), delta );
+		}
+			break;
+
+		case MD::ItemType::TableRow :
+		{
+			auto r = static_cast< MD::TableRow< MD::QStringTrait >* > ( item );
+
+			for( const auto & c : r->cells() )
+				shiftItemLines( c.get(), delta );
+		}
+			break;
+
+		case MD::ItemType::Link :
+		{
+			auto l = static_cast< MD::Link< MD::QStringTrait >* > ( item );
+
+			if( l->p() )
+				shiftItemLines( l->p().get(), delta );
+		}
+			break;
+
+		case MD::ItemType::Image :
+		{
+			auto i = static_cast< MD::Image< MD::QStringTrait >* > ( item );
+
+			if( i->p() )
+				shiftItemLines( i->p().get(), delta );
+		}
+			break;
+
+		default :
+			break;
+	}
+}
+
+void
+restoreLabeledHeadings( MD::Block< MD::QStringTrait > * b, MD::Document< MD::QStringTrait > * doc )
+{
+	for( const auto & item : b->items() )
+	{
+		switch( item->type() )
+		{
+			case MD::ItemType::Heading :
+			{
+				auto h = std::static_pointer_cast< MD::Heading< MD::QStringTrait > > ( item );
+
+				if( !h->label().isEmpty() )
+					doc->insertLabeledHeading( h->label(), h );
+			}
+				break;
+
+			case MD::ItemType::Blockquote :
+			case MD::ItemType::List :
+			case MD::ItemType::ListItem :
+				restoreLabeledHeadings( static_cast< MD::Block< MD::QStringTrait >* > ( item.get() ),
+					doc );
+				break;
+
+			default :
+				break;
+		}
+	}
+}
+
+bool
+isReferenceDefinition( QStringView line )
+{
+	qsizetype p = 0;
+
+	while( p < line.size() && line[ p ] == QLatin1Char( ' ' ) )
+		++p;
+
+	if( p > 3 || p >= line.size() || line[ p ] != QLatin1Char( '[' ) )
+		return false;
+
+	const auto close = line.indexOf( QStringLiteral( "]:" ), p );
+
+	return ( close > p + 1 );
+}
+
+
+//! Replace paragraph and line separators of QTextDocument's raw text with
+//! line feeds in place, like QTextDocument::toPlainText() does.
+static void
+normalizeRawText( QString & md )
+{
+	for( auto & c : md )
+	{
+		if( c == QChar::ParagraphSeparator || c == QChar::LineSeparator )
+			c = QLatin1Char( '\n' );
+		else if( c == QChar::Nbsp )
+			c = QLatin1Char( ' ' );
+	}
+}
+
+
+//
+// ParsingThreadPrivate
+//
+
+struct ParsingThreadPrivate {
+	//! Data to parse.
+	struct Job {
+		//! Markdown to parse.
+		QString md;
+		//! File name of the document.
+		QString fileName;
+		//! Counter of the queued data.
+		unsigned long long int counter = 0;
+		//! Is it a slice of the document?
+		bool isSlice = false;
+		//! First line of the slice.
+		long long int startLine = 0;
+		//! Lines count in the slice.
+		long long int linesCount = 0;
+		//! Last line of the slice before modification.
+		long long int oldEndLine = 0;
+		//! Change of lines count.
+		long long int delta = 0;
+	}; // struct Job
+
+	//! Reference definition in the document.
+	struct Definition {
+		long long int startLine = 0;
+		long long int endLine = 0;
+		QString text;
+	}; // struct Definition
+
+	//! Collect reference definitions of the whole document.
+	void collectDefinitions( const QString & md )
+	{
+		auto & tmp = definitionsBuffer;
+		tmp.clear();
+
+		long long int line = 0;
+		qsizetype pos = 0;
+		bool inDefinition = false;
+
+		while( pos <= md.size() )
+		{
+			auto end = md.indexOf( QLatin1Char( '\n' ), pos );
+
+			if( end == -1 )
+				end = md.size();
+
+			const auto l = QStringView( md ).sliced( pos, end - pos );
+
+			if( isReferenceDefinition( l ) )
+			{
+				tmp.push_back( { line, line, l.toString() } );
+				inDefinition = true;
+			}
+			else if( inDefinition && !l.trimmed().isEmpty() )
+			{
+				tmp.back().endLine = line;
+				tmp.back().text.append( QLatin1Char( '\n' ) );
+				tmp.back().text.append( l );
+			}
+			else
+				inDefinition = false;
+
+			pos = end + 1;
+			++line;
+		}
+
+		QMutexLocker lock( &mutex );
+
+		definitions.swap( tmp );
+	}
+
+	//! Guard.
+	mutable QMutex mutex;
+	//! Wakes up thread on new data or stop.
+	QWaitCondition condition;
+	//! Queued data.
+	Job job;
+	//! Is there not yet parsed data?
+	bool hasData = false;
+	//! Wakes up waiting for result on new result or stop.
+	QWaitCondition resultCondition;
+
+	//! Last emitted result.
+	struct Result {
+		//! Counter of the data.
+		unsigned long long int counter = 0;
+		//! Document.
+		std::shared_ptr< MD::Document< MD::QStringTrait > > doc;
+		//! Syntax highlighting spans.
+		std::shared_ptr< SyntaxSpans > spans;
+	}; // struct Result
+
+	//! Last emitted result, for waiting on it.
+	Result result;
+	//! Should thread finish?
+	bool stopped = false;
+	//! Reference definitions of the last parsed document. They are appended to
+	//! slices so reference links and footnote references resolve.
+	std::vector< Definition > definitions;
+	//! Buffers below live as long as the thread to not reallocate them on each run.
+	//! Previous definitions, reused on next collecting.
+	std::vector< Definition > definitionsBuffer;
+	//! Text of the slice with appended definitions.
+	QString sliceText;
+	//! Parser.
+	MD::Parser< MD::QStringTrait > parser;
+}; // struct ParsingThreadPrivate
+
+
+//
+// ParsingThread
+//
+
+ParsingThread::ParsingThread( QObject * parent )
+	:	QThread( parent )
+	,	d( new ParsingThreadPrivate )
+{
+}
+
+ParsingThread::~ParsingThread()
+{
+}
+
+void
+ParsingThread::prepare( QString md, const QString & fileName,
+	unsigned long long int counter )
+{
+	QMutexLocker lock( &d->mutex );
+
+	d->job = {};
+	d->job.md = std::move( md );
+	d->job.fileName = fileName;
+	d->job.counter = counter;
+	d->hasData = true;
+
+	d->condition.wakeOne();
+}
+
+void
+ParsingThread::prepareSlice( QString md, const QString & fileName,
+	unsigned long long int counter, long long int startLine,
+	long long int linesCount, long long int oldEndLine, long long int delta )
+{
+	QMutexLocker lock( &d->mutex );
+
+	d->job.md = std::move( md );
+	d->job.fileName = fileName;
+	d->job.counter = counter;
+	d->job.isSlice = true;
+	d->job.startLine = startLine;
+	d->job.linesCount = linesCount;
+	d->job.oldEndLine = oldEndLine;
+	d->job.delta = delta;
+	d->hasData = true;
+
+	d->condition.wakeOne();
+}
+
+bool
+ParsingThread::hasDefinitions( long long int startLine, long long int endLine ) const
+{
+	QMutexLocker lock( &d->mutex );
+
+	for( const auto & def : std::as_const( d->definitions ) )
+	{
+		if( def.startLine <= endLine && def.endLine >= startLine )
+			return true;
+	}
+
+	return false;
+}
+
+void
+ParsingThread::stop()
+{
+	QMutexLocker lock( &d->mutex );
+
+	d->stopped = true;
+
+	d->condition.wakeOne();
+	d->resultCondition.wakeAll();
+}
+
+bool
+ParsingThread::waitForResult( unsigned long long int counter,
+	std::shared_ptr< MD::Document< MD::QStringTrait > > & doc,
+	std::shared_ptr< SyntaxSpans > & spans )
+{
+	QMutexLocker lock( &d->mutex );
+
+	while( !d->stopped && d->result.counter < counter )
+		d->resultCondition.wait( &d->mutex );
+
+	if( d->result.counter != counter )
+		return false;
+
+	doc = d->result.doc;
+	spans = d->result.spans;
+
+	return true;
+}
+
+void
+ParsingThread::run()
+{
+	while( true )
+	{
+		QMutexLocker lock( &d->mutex );
+
+		while( !d->stopped && !d->hasData )
+			d->condition.wait( &d->mutex );
+
+		if( d->stopped )
+			return;
+
+		auto job = std::move( d->job );
+		d->job = {};
+		d->hasData = false;
+
+		if( job.isSlice )
+		{
+			// Slice is parsed just like the same lines in the whole text.
+			normalizeRawText( job.md );
+
+			// resize() keeps allocated capacity.
+			d->sliceText.resize( 0 );
+			d->sliceText.append( job.md );
+			d->sliceText.append( QStringLiteral( "\n\n" ) );
+
+			for( auto & def : d->definitions )
+			{
+				if( def.startLine > job.oldEndLine )
+				{
+					def.startLine += job.delta;
+					def.endLine += job.delta;
+				}
+
+				d->sliceText.append( def.text );
+				d->sliceText.append( QLatin1Char( '\n' ) );
+			}
+		}
+
+		lock.unlock();
+
+		if( !job.isSlice )
+		{
+			normalizeRawText( job.md );
+
+			d->collectDefinitions( job.md );
+		}
+
+		// Stream reads shared snapshot, no copy of the text here.
+		QTextStream stream( job.isSlice ? &d->sliceText : &job.md, QIODevice::ReadOnly );
+
+		auto doc = d->parser.parse( stream, job.fileName );
+
+		std::shared_ptr< SyntaxSpans > spans;
+
+		if( job.isSlice )
+		{
+			auto slice = std::make_shared< MD::Document< MD::QStringTrait > > ();
+
+			for( const auto & item : doc->items() )
+			{
+				// Anchor of the file and items of appended definitions.
+				if( item->type() == MD::ItemType::Anchor || item->startLine() < 0 ||
+					item->startLine() >= job.linesCount )
+						continue;
+
+				shiftItemLines( item.get(), job.startLine );
+
+				slice->appendItem( item );
+			}
+
+			// Footnotes are needed to resolve references of the slice.
+			// Shifted, they stay below lines of the slice.
+			for( const auto & f : doc->footnotesMap() )
+			{
+				shiftItemLines( f.second.get(), job.startLine );
+
+				slice->insertFootnote( f.first, f.second );
+			}
+
+			doc = slice;
+
+			spans = SyntaxVisitor::build( doc, job.startLine, job.linesCount );
+		}
+		else
+			spans = SyntaxVisitor::build( doc, 0, job.md.count( QLatin1Char( '\n' ) ) + 1 );
+
+		lock.relock();
+
+		// Newer data was queued while parsing, this result is out of date.
+		if( d->hasData && d->job.counter != job.counter )
+			continue;
+
+		d->result = { job.counter, doc, spans };
+		d->resultCondition.wakeAll();
+
+		lock.unlock();
+
+		emit parsingDone( doc, spans, job.counter );
+	}
+}
+
+} /* namespace MdEditor */
@@ -0,0 +1,113 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Qt include.
+#include <QThread>
+#include <QScopedPointer>
+
+// md4qt include.
+#define MD4QT_QT_SUPPORT
+#include <md4qt/traits.hpp>
+#include <md4qt/parser.hpp>
+
+// md-editor include.
+#include "syntaxvisitor.hpp"
+
+// C++ include.
+#include <memory>
+
+
+namespace MdEditor {
+
+//! Shift line numbers of the given item and all its children.
+void shiftItemLines( MD::Item< MD::QStringTrait > * item, long long int delta );
+
+//! Fill labeled headings of the document with headings of the given block
+//! and nested blocks.
+void restoreLabeledHeadings( MD::Block< MD::QStringTrait > * b,
+	MD::Document< MD::QStringTrait > * doc );
+
+//! \return Is the given line a link reference definition or a footnote definition?
+bool isReferenceDefinition( QStringView line );
+
+
+//
+// ParsingThread
+//
+
+struct ParsingThreadPrivate;
+
+//! Thread that parses Markdown documents in background.
+class ParsingThread
+	:	public QThread
+{
+	Q_OBJECT
+
+signals:
+	//! Parsing of the data with the given counter is done. For slice data
+	//! \a doc contains only items of the slice with document's line numbers.
+	//! \a spans are syntax highlighting spans of the parsed lines.
+	void parsingDone( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+		std::shared_ptr< MdEditor::SyntaxSpans > spans,
+		unsigned long long int counter );
+
+public:
+	explicit ParsingThread( QObject * parent );
+	~ParsingThread() override;
+
+	//! Queue data for parsing. Only the latest queued data will be parsed,
+	//! previous not yet parsed data is dropped.
+	//! \a md is the raw text of QTextDocument, it's normalized in the thread.
+	void prepare( QString md, const QString & fileName,
+		unsigned long long int counter );
+	//! Queue slice of the document for parsing.
+	//! \a md is the text of the lines [startLine, startLine + linesCount) of the
+	//! document, \a oldEndLine is the last line of the slice before the
+	//! modification and \a delta is the change of lines count. \a md is
+	//! normalized in the thread just like the whole text.
+	//! Should be used only when the last parsed data was accepted.
+	void prepareSlice( QString md, const QString & fileName,
+		unsigned long long int counter, long long int startLine,
+		long long int linesCount, long long int oldEndLine, long long int delta );
+	//! \return Are there reference definitions in the given lines of the last
+	//! parsed document?
+	bool hasDefinitions( long long int startLine, long long int endLine ) const;
+	//! Wait till data with the given counter is parsed. parsingDone() is
+	//! emitted for this data anyway.
+	//! \return false if the thread was stopped or the result was dropped.
+	bool waitForResult( unsigned long long int counter,
+		std::shared_ptr< MD::Document< MD::QStringTrait > > & doc,
+		std::shared_ptr< SyntaxSpans > & spans );
+	//! Ask thread to finish. Call wait() after this.
+	void stop();
+
+protected:
+	void run() override;
+
+private:
+	Q_DISABLE_COPY( ParsingThread )
+
+	QScopedPointer< ParsingThreadPrivate > d;
+}; // class ParsingThread
+
+} /* namespace MdEditor */
@@ -0,0 +1,810 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-editor include.
+#include "syntaxhighlighter.hpp"
+#include "editor.hpp"
+#include "colors.hpp"
+
+// Qt include.
+#include <QTextCharFormat>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QTimer>
+#include <QElapsedTimer>
+
+// C++ include.
+#include <vector>
+
+
+namespace MdEditor {
+
+namespace /* anonymous */ {
+
+//
+// SyntaxBlockData
+//
+
+//! Data of the block with hash of formats set to its layout.
+class SyntaxBlockData final
+	:	public QTextBlockUserData
+{
+public:
+	//! Hash of formats, 0 if there are no formats.
+	size_t formatsHash = 0;
+}; // class SyntaxBlockData
+
+//! Count of combinations of text options: italic, bold, strikethrough.
+static const int c_optsCount = 8;
+
+//! Hash of formats that were not built from spans of the parsed document.
+static const size_t c_foreignHash = ~size_t( 0 );
+
+
+//
+// Line lexer
+//
+
+//! Lexer state: line continues blockquote.
+static const int c_blockquoteState = 1;
+//! Lexer state: line is in fenced code.
+static const int c_fenceState = 2;
+//! Lexer state: fence of the code is of tildes.
+static const int c_tildeFenceState = 4;
+//! Lexer state: length of the fence is stored starting with this bit.
+static const int c_fenceLengthShift = 3;
+
+//! \return Length of the run of the given character starting at \a p.
+static long long int
+runLength( const QString & s, long long int p, QChar c )
+{
+	long long int i = p;
+
+	while( i < s.length() && s[ i ] == c )
+		++i;
+
+	return i - p;
+}
+
+//! \return Position of the first not space character starting at \a p.
+static long long int
+skipSpaces( const QString & s, long long int p )
+{
+	while( p < s.length() && ( s[ p ] == QLatin1Char( ' ' ) || s[ p ] == QLatin1Char( '\t' ) ) )
+		++p;
+
+	return p;
+}
+
+//! Add spans of inline code, links and images of the line starting at \a p.
+static void
+lexInlines( const QString & s, long long int p, std::vector< SyntaxSpan > & spans )
+{
+	while( p < s.length() )
+	{
+		const auto c = s[ p ];
+
+		if( c == QLatin1Char( '\\' ) )
+			p += 2;
+		else if( c == QLatin1Char( '`' ) )
+		{
+			const auto n = runLength( s, p, c );
+			auto close = s.indexOf( c, p + n );
+
+			// Closing run should be of the same length.
+			while( close >= 0 && runLength( s, close, c ) != n )
+				close = s.indexOf( c, close + runLength( s, close, c ) );
+
+			if( close >= 0 )
+			{
+				spans.push_back( { SyntaxKind::InlineCode, 0, p, close + n - 1, 0 } );
+				p = close + n;
+			}
+			else
+				p += n;
+		}
+		else if( c == QLatin1Char( '[' ) ||
+			( c == QLatin1Char( '!' ) && p + 1 < s.length() && s[ p + 1 ] == QLatin1Char( '[' ) ) )
+		{
+			const auto open = ( c == QLatin1Char( '!' ) ? p + 1 : p );
+			const auto text = s.indexOf( QLatin1Char( ']' ), open + 1 );
+			const auto end = ( text > 0 && text + 1 < s.length() &&
+				s[ text + 1 ] == QLatin1Char( '(' ) ?
+					s.indexOf( QLatin1Char( ')' ), text + 2 ) : -1 );
+
+			if( end > 0 )
+			{
+				spans.push_back( { c == QLatin1Char( '!' ) ? SyntaxKind::Image : SyntaxKind::Link,
+					0, p, end, 0 } );
+				p = end + 1;
+			}
+			else
+				p = open + 1;
+		}
+		else
+			++p;
+	}
+}
+
+//! Lex the line of Markdown, \a state is the state of the previous line. It's
+//! a rough approximation of the highlighting, that is shown till the document
+//! is parsed. If \a spans is null only the state is calculated.
+//! \return State of the line.
+static int
+lexLine( const QString & s, int state, std::vector< SyntaxSpan > * spans )
+{
+	long long int p = 0;
+	int depth = 0;
+
+	// Blockquote markers.
+	while( true )
+	{
+		const auto m = skipSpaces( s, p );
+
+		if( m < s.length() && s[ m ] == QLatin1Char( '>' ) )
+		{
+			p = m + 1;
+			++depth;
+		}
+		else
+			break;
+	}
+
+	p = skipSpaces( s, p );
+
+	if( state & c_fenceState )
+	{
+		if( spans )
+			spans->push_back( { SyntaxKind::Code, 0, 0, -1, 0 } );
+
+		const QChar fence = QLatin1Char( state & c_tildeFenceState ? '~' : '`' );
+		const auto n = runLength( s, p, fence );
+
+		if( n >= ( state >> c_fenceLengthShift ) && skipSpaces( s, p + n ) == s.length() )
+			return 0;
+
+		return state;
+	}
+
+	const bool blockquote = ( depth > 0 ||
+		( ( state & c_blockquoteState ) && p < s.length() ) );
+
+	if( p == s.length() )
+	{
+		if( spans && depth )
+			spans->push_back( { SyntaxKind::Blockquote, 0, 0, -1, 0 } );
+
+		return 0;
+	}
+
+	const auto c = s[ p ];
+
+	// Fence of the code.
+	if( c == QLatin1Char( '`' ) || c == QLatin1Char( '~' ) )
+	{
+		const auto n = runLength( s, p, c );
+
+		if( n >= 3 && ( c == QLatin1Char( '~' ) || s.indexOf( c, p + n ) < 0 ) )
+		{
+			if( spans )
+				spans->push_back( { SyntaxKind::Code, 0, 0, -1, 0 } );
+
+			return ( c_fenceState | ( c == QLatin1Char( '~' ) ? c_tildeFenceState : 0 ) |
+				static_cast< int > ( qMin( n, 1024ll ) << c_fenceLengthShift ) );
+		}
+	}
+
+	const int lineState = ( blockquote ? c_blockquoteState : 0 );
+
+	if( !spans )
+		return lineState;
+
+	if( blockquote )
+		spans->push_back( { SyntaxKind::Blockquote, 0, 0, -1, 0 } );
+
+	spans->push_back( { SyntaxKind::Text, 0, p, -1, 0 } );
+
+	if( c == QLatin1Char( '#' ) )
+	{
+		const auto n = runLength( s, p, c );
+
+		if( n <= 6 && ( p + n == s.length() || s[ p + n ] == QLatin1Char( ' ' ) ) )
+			spans->push_back( { SyntaxKind::Heading, MD::BoldText, p, -1, 0 } );
+	}
+	else if( ( c == QLatin1Char( '-' ) || c == QLatin1Char( '+' ) || c == QLatin1Char( '*' ) ) &&
+		( p + 1 == s.length() || s[ p + 1 ] == QLatin1Char( ' ' ) ) )
+			spans->push_back( { SyntaxKind::List, 0, p, -1, 0 } );
+	else if( c.isDigit() )
+	{
+		auto i = p;
+
+		while( i < s.length() && i - p < 9 && s[ i ].isDigit() )
+			++i;
+
+		if( i < s.length() && ( s[ i ] == QLatin1Char( '.' ) || s[ i ] == QLatin1Char( ')' ) ) &&
+			( i + 1 == s.length() || s[ i + 1 ] == QLatin1Char( ' ' ) ) )
+				spans->push_back( { SyntaxKind::List, 0, p, -1, 0 } );
+	}
+
+	lexInlines( s, p, *spans );
+
+	return lineState;
+}
+
+} /* namespace anonymous */
+
+
+//
+// SyntaxHighlighterPrivate
+//
+
+struct SyntaxHighlighterPrivate {
+	SyntaxHighlighterPrivate( Editor * e )
+		:	editor( e )
+	{
+		backgroundTimer.setSingleShot( true );
+		backgroundTimer.setInterval( 0 );
+	}
+
+	//! Mark all lines as not applied. Layouts keep their formats till new ones are applied.
+	void resetApplied()
+	{
+		for( auto & line : lines )
+			line.applied = false;
+
+		restartBackground();
+	}
+
+	//! Stop the background pass, the next one starts from visible lines.
+	void restartBackground()
+	{
+		backgroundTimer.stop();
+		backgroundDone = false;
+	}
+
+	//! Apply formats of the next lines of the background pass for a few
+	//! milliseconds, the pass continues from the event loop.
+	void applyInBackground()
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		const auto count = static_cast< long long int > ( lines.size() );
+
+		while( backgroundCount < count && timer.elapsed() < c_sliceTime )
+		{
+			const auto from = ( backgroundStart + backgroundCount ) % count;
+			const auto n = qMin( c_sliceLines, qMin( count - from, count - backgroundCount ) );
+
+			applyFormats( from, from + n - 1 );
+
+			backgroundCount += n;
+		}
+
+		if( backgroundCount < count )
+			backgroundTimer.start();
+		else
+			backgroundDone = true;
+	}
+
+	//! Clear formats of all blocks.
+	void clearFormats()
+	{
+		for( auto block = editor->document()->begin(); block.isValid(); block = block.next() )
+		{
+			auto data = static_cast< SyntaxBlockData* > ( block.userData() );
+
+			if( data )
+				data->formatsHash = 0;
+
+			if( !block.layout()->formats().isEmpty() )
+				block.layout()->clearFormats();
+		}
+
+		resetApplied();
+
+		// Nothing should be applied in background till highlighting is requested.
+		backgroundDone = true;
+	}
+
+	//! Apply formats of the given lines in one pass over blocks. Only blocks
+	//! with changed formats are updated and relaid out.
+	//! \return Was anything applied?
+	bool applyFormats( long long int firstLine, long long int lastLine )
+	{
+		firstLine = qMax( 0ll, firstLine );
+		lastLine = qMin( static_cast< long long int > ( lines.size() ) - 1, lastLine );
+
+		if( firstLine > lastLine )
+			return false;
+
+		QList< QTextLayout::FormatRange > format;
+		auto block = editor->document()->findBlockByNumber( firstLine );
+		int dirtyFrom = -1, dirtyTo = -1;
+
+		for( auto i = firstLine; i <= lastLine && block.isValid(); ++i, block = block.next() )
+		{
+			auto & line = lines[ i ];
+			auto data = static_cast< SyntaxBlockData* > ( block.userData() );
+
+			// Formats set by the line lexer are always replaced.
+			if( line.applied && !( data && data->formatsHash == c_foreignHash ) )
+				continue;
+
+			line.applied = true;
+
+			format.clear();
+			format.reserve( line.spans.size() );
+
+			size_t hash = 0;
+
+			if( !line.spans.empty() )
+			{
+				// Blockquote markers of the line are scanned once for all its spans.
+				bool scanned = false;
+
+				hash = generation;
+
+				for( const auto & s : line.spans )
+				{
+					if( s.start < 0 && !scanned )
+					{
+						scanBlockquotes( block.text() );
+						scanned = true;
+					}
+
+					const auto start = ( s.start < 0 ?
+						blockquoteOffset( s.blockquoteDepth ) : s.start );
+					const auto idx = formatIndex( s.kind, s.opts );
+
+					QTextLayout::FormatRange f;
+					f.format = formats[ idx ];
+					f.start = start;
+					f.length = ( s.end < 0 ? block.length() - start : s.end + 1 - start );
+
+					hash = qHashMulti( hash, f.start, f.length, idx );
+
+					format.push_back( f );
+				}
+
+				// 0 is reserved for block without formats, c_foreignHash for
+				// formats of the line lexer.
+				if( !hash || hash == c_foreignHash )
+					hash = 1;
+			}
+
+			const size_t appliedHash = ( data ? data->formatsHash :
+				( block.layout()->formats().isEmpty() ? 0 : c_foreignHash ) );
+
+			if( hash == appliedHash )
+				continue;
+
+			if( !data )
+			{
+				data = new SyntaxBlockData;
+				block.setUserData( data );
+			}
+
+			data->formatsHash = hash;
+
+			block.layout()->setFormats( format );
+
+			if( dirtyFrom < 0 )
+				dirtyFrom = block.position();
+
+			dirtyTo = block.position() + block.length();
+		}
+
+		if( dirtyFrom < 0 )
+			return false;
+
+		applying = true;
+		editor->document()->markContentsDirty( dirtyFrom, dirtyTo - dirtyFrom );
+		applying = false;
+
+		return true;
+	}
+
+	//! \return Lexer state of the block before the given one. Unknown states
+	//! of previous blocks are calculated.
+	int previousState( const QTextBlock & block )
+	{
+		auto prev = block.previous();
+
+		while( prev.isValid() && prev.userState() < 0 )
+			prev = prev.previous();
+
+		int state = ( prev.isValid() ? prev.userState() : 0 );
+
+		for( auto b = ( prev.isValid() ? prev.next() : editor->document()->begin() );
+			b != block; b = b.next() )
+		{
+			state = lexLine( b.text(), state, nullptr );
+			b.setUserState( state );
+		}
+
+		return state;
+	}
+
+	//! Set formats of the lexed spans to the block.
+	void setLexedFormats( QTextBlock & block, const std::vector< SyntaxSpan > & spans )
+	{
+		QList< QTextLayout::FormatRange > format;
+		format.reserve( spans.size() );
+
+		for( const auto & s : spans )
+		{
+			QTextLayout::FormatRange f;
+			f.format = formats[ formatIndex( s.kind, s.opts ) ];
+			f.start = s.start;
+			f.length = ( s.end < 0 ? block.length() - s.start : s.end + 1 - s.start );
+
+			format.push_back( f );
+		}
+
+		auto data = static_cast< SyntaxBlockData* > ( block.userData() );
+
+		if( !data )
+		{
+			data = new SyntaxBlockData;
+			block.setUserData( data );
+		}
+
+		data->formatsHash = c_foreignHash;
+
+		block.layout()->setFormats( format );
+	}
+
+	//! Find positions after blockquote markers of the line.
+	void scanBlockquotes( const QString & s )
+	{
+		blockquoteOffsets.clear();
+
+		long long int p = 0;
+
+		while( true )
+		{
+			while( p < s.length() && s[ p ].isSpace() )
+				++p;
+
+			if( p < s.length() && s[ p ] == QLatin1Char( '>' ) )
+				blockquoteOffsets.push_back( ++p );
+			else
+				break;
+		}
+	}
+
+	//! \return Position after blockquote markers of the given depth in the scanned line.
+	long long int blockquoteOffset( int depth ) const
+	{
+		if( blockquoteOffsets.empty() )
+			return 0;
+
+		return blockquoteOffsets[ qMin( static_cast< size_t > ( depth ),
+			blockquoteOffsets.size() ) - 1 ];
+	}
+
+	//! \return Does the kind of item have own font?
+	static bool hasFont( SyntaxKind kind )
+	{
+		switch( kind )
+		{
+			case SyntaxKind::Text :
+			case SyntaxKind::Heading :
+			case SyntaxKind::List :
+			case SyntaxKind::Link :
+				return true;
+
+			default :
+				return false;
+		}
+	}
+
+	//! \return Color of the kind of item.
+	QColor color( SyntaxKind kind ) const
+	{
+		switch( kind )
+		{
+			case SyntaxKind::Math :
+				return colors.mathColor;
+
+			case SyntaxKind::Heading :
+				return colors.headingColor;
+
+			case SyntaxKind::Code :
+				return colors.codeColor;
+
+			case SyntaxKind::InlineCode :
+				return colors.inlineColor;
+
+			case SyntaxKind::Blockquote :
+				return colors.blockquoteColor;
+
+			case SyntaxKind::List :
+				return colors.listColor;
+
+			case SyntaxKind::Table :
+				return colors.tableColor;
+
+			case SyntaxKind::Html :
+				return colors.htmlColor;
+
+			case SyntaxKind::Link :
+			case SyntaxKind::Image :
+				return colors.linkColor;
+
+			case SyntaxKind::Footnote :
+				return colors.footnoteColor;
+
+			default :
+				return colors.textColor;
+		}
+	}
+
+	//! Build formats of all kinds of items with all text options.
+	void buildFormats()
+	{
+		formats.resize( static_cast< size_t > ( SyntaxKind::Count ) * c_optsCount );
+
+		for( int k = 0; k < static_cast< int > ( SyntaxKind::Count ); ++k )
+		{
+			const auto kind = static_cast< SyntaxKind > ( k );
+
+			for( int opts = 0; opts < c_optsCount; ++opts )
+			{
+				auto & f = formats[ k * c_optsCount + opts ];
+				f = QTextCharFormat();
+				f.setForeground( color( kind ) );
+
+				if( hasFont( kind ) )
+					f.setFont( styleFont( opts ) );
+			}
+		}
+
+		++generation;
+
+		resetApplied();
+	}
+
+	//! \return Index of the format of the item.
+	static int formatIndex( SyntaxKind kind, int opts )
+	{
+		return static_cast< int > ( kind ) * c_optsCount +
+			( hasFont( kind ) ? opts & ( c_optsCount - 1 ) : 0 );
+	}
+
+	QFont styleFont( int opts )
+	{
+		auto f = font;
+
+		if( opts & MD::ItalicText )
+			f.setItalic( true );
+
+		if( opts & MD::BoldText )
+			f.setBold( true );
+
+		if( opts & MD::StrikethroughText )
+			f.setStrikeOut( true );
+
+		return f;
+	}
+
+	//! Editor.
+	Editor * editor = nullptr;
+	//! Colors.
+	Colors colors;
+
+	struct Line {
+		std::vector< SyntaxSpan > spans;
+		//! Are formats set to the layout of the block?
+		bool applied = false;
+	}; // struct Line
+
+	//! Spans indexed by block number.
+	std::vector< Line > lines;
+	//! Formats of all kinds of items with all text options.
+	std::vector< QTextCharFormat > formats;
+	//! Generation of colors and font, formats of another generation are always reapplied.
+	size_t generation = 0;
+	//! Are formats being applied to the document?
+	bool applying = false;
+	//! Count of lines highlighted around visible ones.
+	static const long long int c_margin = 50;
+	//! Duration of one slice of the background pass, in milliseconds.
+	static const qint64 c_sliceTime = 5;
+	//! Count of lines applied at once in the background pass.
+	static const long long int c_sliceLines = 64;
+	//! Applies formats of not visible lines from the event loop.
+	QTimer backgroundTimer;
+	//! First line of the background pass, the pass wraps around the end of the document.
+	long long int backgroundStart = 0;
+	//! Count of lines handled by the background pass.
+	long long int backgroundCount = 0;
+	//! Are all lines applied by the background pass?
+	bool backgroundDone = true;
+	//! Default font.
+	QFont font;
+	//! Positions after blockquote markers of the line being applied.
+	std::vector< long long int > blockquoteOffsets;
+}; // struct SyntaxHighlighterPrivate
+
+
+//
+// SyntaxHighlighter
+//
+
+SyntaxHighlighter::SyntaxHighlighter( Editor * editor )
+	:	d( new SyntaxHighlighterPrivate( editor ) )
+{
+	d->buildFormats();
+
+	QObject::connect( &d->backgroundTimer, &QTimer::timeout, &d->backgroundTimer,
+		[this]() { d->applyInBackground(); } );
+}
+
+SyntaxHighlighter::~SyntaxHighlighter()
+{
+}
+
+void
+SyntaxHighlighter::setSpans( std::shared_ptr< SyntaxSpans > spans )
+{
+	d->lines.clear();
+	d->restartBackground();
+
+	if( !spans )
+		return;
+
+	d->lines.resize( spans->lines.size() );
+
+	for( size_t i = 0; i < spans->lines.size(); ++i )
+		d->lines[ i ].spans = std::move( spans->lines[ i ] );
+}
+
+void
+SyntaxHighlighter::spliceSpans( std::shared_ptr< SyntaxSpans > spans,
+	long long int oldEndLine )
+{
+	const auto first = qMin( spans->firstLine, static_cast< long long int > ( d->lines.size() ) );
+	const auto last = qBound( first, oldEndLine + 1, static_cast< long long int > ( d->lines.size() ) );
+	const auto count = static_cast< long long int > ( spans->lines.size() );
+
+	d->restartBackground();
+
+	if( count > last - first )
+		d->lines.insert( d->lines.begin() + last, count - ( last - first ),
+			SyntaxHighlighterPrivate::Line() );
+	else
+		d->lines.erase( d->lines.begin() + first + count, d->lines.begin() + last );
+
+	for( long long int i = 0; i < count; ++i )
+	{
+		auto & line = d->lines[ first + i ];
+		line.spans = std::move( spans->lines[ i ] );
+		line.applied = false;
+	}
+}
+
+void
+SyntaxHighlighter::highlightVisible( long long int firstLine, long long int lastLine )
+{
+	const auto last = lastLine + SyntaxHighlighterPrivate::c_margin;
+
+	d->applyFormats( firstLine - SyntaxHighlighterPrivate::c_margin, last );
+
+	// The rest of the document is applied in background, starting after visible lines.
+	if( !d->backgroundDone && !d->backgroundTimer.isActive() && !d->lines.empty() )
+	{
+		d->backgroundStart = ( last + 1 < static_cast< long long int > ( d->lines.size() ) ?
+			qMax( 0ll, last + 1 ) : 0 );
+		d->backgroundCount = 0;
+		d->backgroundTimer.start();
+	}
+}
+
+void
+SyntaxHighlighter::stopBackgroundHighlighting()
+{
+	d->restartBackground();
+}
+
+void
+SyntaxHighlighter::preHighlight( long long int firstLine, long long int lastLine,
+	long long int firstVisible, long long int lastVisible )
+{
+	auto block = d->editor->document()->findBlockByNumber( firstLine );
+
+	if( !block.isValid() )
+		return;
+
+	firstVisible -= SyntaxHighlighterPrivate::c_margin;
+	lastVisible += SyntaxHighlighterPrivate::c_margin;
+
+	int state = d->previousState( block );
+	int dirtyFrom = -1, dirtyTo = -1;
+	std::vector< SyntaxSpan > spans;
+
+	for( auto i = firstLine; block.isValid(); ++i, block = block.next() )
+	{
+		const bool visible = ( i >= firstVisible && i <= lastVisible );
+		const int old = block.userState();
+
+		spans.clear();
+		state = lexLine( block.text(), state, visible ? &spans : nullptr );
+		block.setUserState( state );
+
+		if( visible )
+		{
+			d->setLexedFormats( block, spans );
+
+			if( dirtyFrom < 0 )
+				dirtyFrom = block.position();
+
+			dirtyTo = block.position() + block.length();
+		}
+
+		// Next lines are lexed only while their states change, like
+		// QSyntaxHighlighter does.
+		if( i >= lastLine && state == old )
+			break;
+	}
+
+	if( dirtyFrom < 0 )
+		return;
+
+	d->applying = true;
+	d->editor->document()->markContentsDirty( dirtyFrom, dirtyTo - dirtyFrom );
+	d->applying = false;
+}
+
+void
+SyntaxHighlighter::setColors( const Colors & colors )
+{
+	if( d->colors != colors )
+	{
+		d->colors = colors;
+		d->buildFormats();
+	}
+}
+
+void
+SyntaxHighlighter::setFont( const QFont & f )
+{
+	if( d->font != f )
+	{
+		d->font = f;
+		d->buildFormats();
+	}
+}
+
+void
+SyntaxHighlighter::clearHighlighting()
+{
+	d->clearFormats();
+}
+
+bool
+SyntaxHighlighter::isApplyingFormats() const
+{
+	return d->applying;
+}
+
+} /* namespace MdEditor */
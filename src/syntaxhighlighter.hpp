@@ -0,0 +1,85 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// md-editor include.
+#include "syntaxvisitor.hpp"
+
+// Qt include.
+#include <QScopedPointer>
+#include <QFont>
+
+// C++ include.
+#include <memory>
+
+
+namespace MdEditor {
+
+class Editor;
+struct Colors;
+
+//
+// SyntaxHighlighter
+//
+
+struct SyntaxHighlighterPrivate;
+
+//! Applies syntax highlighting spans to the editor. Only visible lines are
+//! highlighted, lines coming into view are highlighted on demand.
+class SyntaxHighlighter final
+{
+public:
+	explicit SyntaxHighlighter( Editor * editor );
+	~SyntaxHighlighter();
+
+	//! Set spans of the whole document.
+	void setSpans( std::shared_ptr< SyntaxSpans > spans );
+	//! Replace spans of lines [spans->firstLine, oldEndLine] as they were before
+	//! modification with the given ones.
+	void spliceSpans( std::shared_ptr< SyntaxSpans > spans, long long int oldEndLine );
+	//! Quickly highlight modified lines [firstLine, lastLine] with the line lexer
+	//! till spans of the parsed document arrive. Formats are set only to lines
+	//! around [firstVisible, lastVisible], next lines are lexed while their states change.
+	void preHighlight( long long int firstLine, long long int lastLine,
+		long long int firstVisible, long long int lastVisible );
+	//! Highlight the given visible lines if they are not highlighted yet. The
+	//! rest of lines is highlighted in background by time slices.
+	void highlightVisible( long long int firstLine, long long int lastLine );
+	//! Stop highlighting in background, spans don't correspond to the text.
+	//! It's continued by highlightVisible().
+	void stopBackgroundHighlighting();
+	//! Set colors. Only formats are rebuilt, visible lines should be highlighted then.
+	void setColors( const Colors & colors );
+	//! Set font. Only formats are rebuilt, visible lines should be highlighted then.
+	void setFont( const QFont & f );
+	//! Clear formats of all blocks. Spans are kept.
+	void clearHighlighting();
+	//! \return Are formats being applied? Document emits change signals then.
+	bool isApplyingFormats() const;
+
+private:
+	Q_DISABLE_COPY( SyntaxHighlighter )
+
+	QScopedPointer< SyntaxHighlighterPrivate > d;
+}; // class SyntaxHighlighter
+
+} /* namespace MdEditor */
@@ -22,14 +22,12 @@
 
 // md-editor include.
 #include "syntaxvisitor.hpp"
-#include "editor.hpp"
-#include "colors.hpp"
 
 // Qt include.
-#include <QTextCursor>
-#include <QTextEdit>
-#include <QTextCharFormat>
-#include <QTextBlock>
+#include <QtConcurrent>
+
+// C++ include.
+#include <algorithm>
 
 
 namespace MdEditor {
@@ -39,161 +37,210 @@ namespace MdEditor {
 //
 
 struct SyntaxVisitorPrivate {
-	SyntaxVisitorPrivate( Editor * e )
-		:	editor( e )
+	//! Add span of the item to the lines of the built range.
+	void setFormat( SyntaxKind kind, int opts,
+		long long int startLine, long long int startColumn,
+		long long int endLine, long long int endColumn )
 	{
-	}
+		if( startLine < 0 )
+			return;
 
-	void clearFormats()
-	{
-		for( const auto & f : std::as_const( formats ) )
-			f.block.layout()->clearFormats();
+		const auto from = qMax( startLine, spans->firstLine );
+		const auto to = qMin( endLine,
+			spans->firstLine + static_cast< long long int > ( spans->lines.size() ) - 1 );
 
-		formats.clear();
-	}
+		for( auto i = from; i <= to; ++i )
+		{
+			// Columns of next lines are counted from blockquote markers.
+			const auto start = ( i == startLine ? startColumn :
+				( blockquoteStackSize ? -1 : 0 ) );
+			const auto end = ( i == endLine ? endColumn : -1 );
 
-	void applyFormats()
-	{
-		for( const auto & f : std::as_const( formats ) )
-			f.block.layout()->setFormats( f.format );
+			spans->lines[ i - spans->firstLine ].push_back(
+				{ kind, opts, start, end, blockquoteStackSize } );
+		}
 	}
 
-	long long int blockquoteOffset( const QString & s ) const
-	{
-		auto findBlockquote = [] ( const QString & s, long long int p ) -> long long int
-		{
-			while( p < s.length() && s[ p ].isSpace() )
-				++p;
+	//! Document.
+	std::shared_ptr< MD::Document< MD::QStringTrait > > doc;
+	//! Spans being built.
+	SyntaxSpans * spans = nullptr;
+	//! Blockquote stack counter.
+	int blockquoteStackSize = 0;
+	//! Text options inherited from enclosing links.
+	int inheritedOpts = 0;
+}; // struct SyntaxVisitorPrivate
 
-			if( p < s.length() && s[ p ] == QLatin1Char( '>' ) )
-				return p;
 
-			return -1;
-		};
+//
+// SyntaxVisitor
+//
 
-		long long int pos = 0, delta = 0, stack = blockquoteStackSize;
+SyntaxVisitor::SyntaxVisitor()
+	:	d( new SyntaxVisitorPrivate )
+{
+}
 
-		while( ( pos = findBlockquote( s, pos ) ) != -1 )
-		{
-			--stack;
-			++pos;
-			delta = pos;
+SyntaxVisitor::~SyntaxVisitor()
+{
+}
 
-			if( !stack )
-				break;
-		}
+std::shared_ptr< SyntaxSpans >
+SyntaxVisitor::build( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+	long long int firstLine, long long int linesCount )
+{
+	auto spans = std::make_shared< SyntaxSpans > ();
+	spans->firstLine = firstLine;
+	spans->lines.resize( qMax( 0ll, linesCount ) );
 
-		return delta;
-	}
+	if( !doc )
+		return spans;
 
-	void setFormat( const QTextCharFormat & format,
-		long long int startLine, long long int startColumn,
-		long long int endLine, long long int endColumn )
+	// Count of top-level items highlighted by one task.
+	static const long long int c_chunkSize = 256;
+
+	const auto & items = doc->items();
+	const long long int count = items.size();
+
+	if( count <= c_chunkSize )
+		SyntaxVisitor().buildItems( doc, 0, count, *spans );
+	else
 	{
-		for( auto i = startLine; i <= endLine; ++i )
-		{
-			formats[ i ].block = editor->document()->findBlockByNumber( i );
+		// Chunk of top-level items with spans of the lines they occupy.
+		struct Chunk {
+			long long int first = 0;
+			long long int last = 0;
+			SyntaxSpans spans;
+		}; // struct Chunk
 
-			long long int delta = 0;
+		std::vector< Chunk > chunks;
+		chunks.reserve( ( count + c_chunkSize - 1 ) / c_chunkSize );
 
-			if( blockquoteStackSize )
-				delta = blockquoteOffset( formats[ i ].block.text() );
+		for( long long int i = 0; i < count; i += c_chunkSize )
+		{
+			Chunk c;
+			c.first = i;
+			c.last = qMin( count, i + c_chunkSize );
 
-			QTextLayout::FormatRange r;
-			r.format = format;
-			r.start = ( i == startLine ? startColumn : delta );
-			r.length = ( i == startLine ?
-				( i == endLine ? endColumn - startColumn + 1 :
-					formats[ i ].block.length() - startColumn ) :
-				( i == endLine ? endColumn + 1 - delta : formats[ i ].block.length() - delta ) );
+			long long int from = -1, to = -1;
 
-			formats[ i ].format.push_back( r );
-		}
-	}
+			for( auto j = c.first; j < c.last; ++j )
+			{
+				if( items[ j ]->startLine() < 0 )
+					continue;
 
-	QFont styleFont( int opts )
-	{
-		auto f = font;
+				from = ( from < 0 ? items[ j ]->startLine() : qMin( from, items[ j ]->startLine() ) );
+				to = qMax( to, items[ j ]->endLine() );
+			}
 
-		if( opts & MD::ItalicText )
-			f.setItalic( true );
+			from = qMax( from, firstLine );
+			to = qMin( to, firstLine + linesCount - 1 );
 
-		if( opts & MD::BoldText )
-			f.setBold( true );
+			c.spans.firstLine = from;
 
-		if( opts & MD::StrikethroughText )
-			f.setStrikeOut( true );
+			if( from >= 0 && from <= to )
+				c.spans.lines.resize( to - from + 1 );
 
-		return f;
-	}
+			chunks.push_back( std::move( c ) );
+		}
 
-	//! Editor.
-	Editor * editor = nullptr;
-	//! Document.
-	std::shared_ptr< MD::Document< MD::QStringTrait > > doc;
-	//! Colors.
-	Colors colors;
-
-	struct Format {
-		QTextBlock block;
-		QList< QTextLayout::FormatRange > format;
-	};
-
-	//! Formats.
-	QMap< int, Format > formats;
-	//! Default font.
-	QFont font;
-	//! Blockquote stack counter.
-	int blockquoteStackSize = 0;
-}; // struct SyntaxVisitorPrivate
+		QtConcurrent::blockingMap( chunks,
+			[doc]( Chunk & c )
+			{
+				if( !c.spans.lines.empty() )
+					SyntaxVisitor().buildItems( doc, c.first, c.last, c.spans );
+			} );
 
+		// Spans of chunks are merged in the order of items.
+		for( auto & c : chunks )
+		{
+			for( size_t i = 0; i < c.spans.lines.size(); ++i )
+			{
+				auto & line = spans->lines[ c.spans.firstLine - firstLine + i ];
 
-//
-// SyntaxVisitor
-//
+				if( line.empty() )
+					line = std::move( c.spans.lines[ i ] );
+				else
+					line.insert( line.end(), c.spans.lines[ i ].cbegin(),
+						c.spans.lines[ i ].cend() );
+			}
+		}
+	}
 
-SyntaxVisitor::SyntaxVisitor( Editor * editor )
-	:	d( new SyntaxVisitorPrivate( editor ) )
-{
-}
+	SyntaxVisitor().buildFootnotes( doc, *spans );
 
-SyntaxVisitor::~SyntaxVisitor()
-{
+	return spans;
 }
 
 void
-SyntaxVisitor::setFont( const QFont & f )
+SyntaxVisitor::buildItems( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+	long long int first, long long int last, SyntaxSpans & spans )
 {
-	d->font = f;
+	d->doc = doc;
+	d->spans = &spans;
+
+	const auto & items = doc->items();
+	const auto to = spans.firstLine + static_cast< long long int > ( spans.lines.size() );
+
+	for( auto i = first; i < last; ++i )
+	{
+		if( items[ i ]->endLine() >= spans.firstLine && items[ i ]->startLine() < to )
+			onItem( items[ i ].get() );
+	}
 }
 
 void
-SyntaxVisitor::clearHighlighting()
+SyntaxVisitor::buildFootnotes( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+	SyntaxSpans & spans )
 {
-	d->clearFormats();
+	d->doc = doc;
+	d->spans = &spans;
+
+	const auto to = spans.firstLine + static_cast< long long int > ( spans.lines.size() );
+
+	for( const auto & f : doc->footnotesMap() )
+	{
+		if( f.second->endLine() >= spans.firstLine && f.second->startLine() < to )
+			onFootnote( f.second.get() );
+	}
 }
 
 void
-SyntaxVisitor::highlight( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
-	const Colors & colors )
+SyntaxVisitor::onItem( MD::Item< MD::QStringTrait > * item )
 {
-	d->clearFormats();
+	switch( item->type() )
+	{
+		case MD::ItemType::Heading :
+			onHeading( static_cast< MD::Heading< MD::QStringTrait >* > ( item ) );
+			break;
 
-	d->doc = doc;
-	d->colors = colors;
+		case MD::ItemType::Paragraph :
+			onParagraph( static_cast< MD::Paragraph< MD::QStringTrait >* > ( item ), true );
+			break;
 
-	if( d->doc )
-	{
-		MD::Visitor< MD::QStringTrait >::process( d->doc );
+		case MD::ItemType::Code :
+			onCode( static_cast< MD::Code< MD::QStringTrait >* > ( item ) );
+			break;
 
-		for( auto it = d->doc->footnotesMap().cbegin(), last = d->doc->footnotesMap().cend();
-			it != last; ++it )
-		{
-			onFootnote( it->second.get() );
-		}
-	}
+		case MD::ItemType::Blockquote :
+			onBlockquote( static_cast< MD::Blockquote< MD::QStringTrait >* > ( item ) );
+			break;
+
+		case MD::ItemType::List :
+			onList( static_cast< MD::List< MD::QStringTrait >* > ( item ) );
+			break;
+
+		case MD::ItemType::Table :
+			onTable( static_cast< MD::Table< MD::QStringTrait >* > ( item ) );
+			break;
+
+		case MD::ItemType::RawHtml :
+			onRawHtml( static_cast< MD::RawHtml< MD::QStringTrait >* > ( item ) );
+			break;
 
-	d->applyFormats();
+		default :
+			break;
+	}
 }
 
 void
@@ -204,21 +251,15 @@ SyntaxVisitor::onAddLineEnding()
 void
 SyntaxVisitor::onText( MD::Text< MD::QStringTrait > * t )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.textColor );
-	format.setFont( d->styleFont( t->opts() ) );
-
-	d->setFormat( format, t->startLine(), t->startColumn(),
+	d->setFormat( SyntaxKind::Text, t->opts() | d->inheritedOpts,
+		t->startLine(), t->startColumn(),
 		t->endLine(), t->endColumn() );
 }
 
 void
 SyntaxVisitor::onMath( MD::Math< MD::QStringTrait > * m )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.mathColor );
-
-	d->setFormat( format, m->startLine(), m->startColumn(),
+	d->setFormat( SyntaxKind::Math, 0, m->startLine(), m->startColumn(),
 		m->endLine(), m->endColumn() );
 }
 
@@ -230,41 +271,29 @@ SyntaxVisitor::onLineBreak( MD::LineBreak< MD::QStringTrait > * b )
 void
 SyntaxVisitor::onHeading( MD::Heading< MD::QStringTrait > * h )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.headingColor );
-	format.setFont( d->styleFont( MD::BoldText ) );
-
-	d->setFormat( format, h->startLine(), h->startColumn(),
+	d->setFormat( SyntaxKind::Heading, MD::BoldText,
+		h->startLine(), h->startColumn(),
 		h->endLine(), h->endColumn() );
 }
 
 void
 SyntaxVisitor::onCode( MD::Code< MD::QStringTrait > * c )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.codeColor );
-
-	d->setFormat( format, c->startLine(), c->startColumn(),
+	d->setFormat( SyntaxKind::Code, 0, c->startLine(), c->startColumn(),
 		c->endLine(), c->endColumn() );
 }
 
 void
 SyntaxVisitor::onInlineCode( MD::Code< MD::QStringTrait > * c )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.inlineColor );
-
-	d->setFormat( format, c->startLine(), c->startColumn(),
+	d->setFormat( SyntaxKind::InlineCode, 0, c->startLine(), c->startColumn(),
 		c->endLine(), c->endColumn() );
 }
 
 void
 SyntaxVisitor::onBlockquote( MD::Blockquote< MD::QStringTrait > * b )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.blockquoteColor );
-
-	d->setFormat( format, b->startLine(), b->startColumn(),
+	d->setFormat( SyntaxKind::Blockquote, 0, b->startLine(), b->startColumn(),
 		b->endLine(), b->endColumn() );
 
 	++d->blockquoteStackSize;
@@ -293,11 +322,7 @@ SyntaxVisitor::onList( MD::List< MD::QStringTrait > * l )
 void
 SyntaxVisitor::onListItem( MD::ListItem< MD::QStringTrait > * l, bool first )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.listColor );
-	format.setFont( d->font );
-
-	d->setFormat( format, l->startLine(), l->startColumn(),
+	d->setFormat( SyntaxKind::List, 0, l->startLine(), l->startColumn(),
 		l->endLine(), l->endColumn() );
 
 	MD::Visitor< MD::QStringTrait >::onListItem( l, first );
@@ -306,10 +331,7 @@ SyntaxVisitor::onListItem( MD::ListItem< MD::QStringTrait > * l, bool first )
 void
 SyntaxVisitor::onTable( MD::Table< MD::QStringTrait > * t )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.tableColor );
-
-	d->setFormat( format, t->startLine(), t->startColumn(),
+	d->setFormat( SyntaxKind::Table, 0, t->startLine(), t->startColumn(),
 		t->endLine(), t->endColumn() );
 
 	if( !t->isEmpty() )
@@ -349,10 +371,7 @@ SyntaxVisitor::onAnchor( MD::Anchor< MD::QStringTrait > * a )
 void
 SyntaxVisitor::onRawHtml( MD::RawHtml< MD::QStringTrait > * h )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.htmlColor );
-
-	d->setFormat( format, h->startLine(), h->startColumn(),
+	d->setFormat( SyntaxKind::Html, 0, h->startLine(), h->startColumn(),
 		h->endLine(), h->endColumn() );
 }
 
@@ -361,101 +380,29 @@ SyntaxVisitor::onHorizontalLine( MD::HorizontalLine< MD::QStringTrait > * l )
 {
 }
 
-namespace /* anonymous */ {
-void
-copyPositions( MD::Item< MD::QStringTrait > * from,
-	MD::Item< MD::QStringTrait > * to )
-{
-	to->setStartColumn( from->startColumn() );
-	to->setStartLine( from->startLine() );
-	to->setEndColumn( from->endColumn() );
-	to->setEndLine( from->endLine() );
-}
-
-std::shared_ptr< MD::Paragraph< MD::QStringTrait > >
-copyParagraphAndApplyOpts( std::shared_ptr< MD::Paragraph< MD::QStringTrait > > p, int opts )
-{
-	auto tmp = std::make_shared< MD::Paragraph< MD::QStringTrait > > ();
-	copyPositions( p.get(), tmp.get() );
-
-	for( const auto & i : p->items() )
-	{
-		switch( i->type() )
-		{
-			case MD::ItemType::Text :
-			{
-				auto from = static_cast< MD::Text< MD::QStringTrait > * > ( i.get() );
-				auto t = std::make_shared< MD::Text< MD::QStringTrait > > ();
-				copyPositions( i.get(), t.get() );
-				t->setText( from->text() );
-				t->setSpaceBefore( from->isSpaceBefore() );
-				t->setSpaceAfter( from->isSpaceAfter() );
-				t->setOpts( opts | from->opts() );
-				tmp->appendItem( t );
-			}
-				break;
-
-			case MD::ItemType::Link :
-			{
-				auto from = static_cast< MD::Link< MD::QStringTrait > * > ( i.get() );
-				auto l = std::make_shared< MD::Link< MD::QStringTrait > > ();
-				copyPositions( i.get(), l.get() );
-				l->setText( from->text() );
-				l->setImg( from->img() );
-				l->setUrl( from->url() );
-				l->setOpts( opts | from->opts() );
-				l->setP( copyParagraphAndApplyOpts( from->p(), opts ) );
-				tmp->appendItem( l );
-			}
-				break;
-
-			case MD::ItemType::Code :
-			{
-				auto from = static_cast< MD::Code< MD::QStringTrait > * > ( i.get() );
-				auto c = std::make_shared< MD::Code< MD::QStringTrait > > (
-					from->text(), false, from->isInlined() );
-				copyPositions( i.get(), c.get() );
-				c->setSyntax( from->syntax() );
-				c->setOpts( opts | from->opts() );
-				tmp->appendItem( c );
-			}
-				break;
-
-			default :
-				tmp->appendItem( i );
-				break;
-		}
-	}
-
-	return tmp;
-}
-
-} /* namespace anonymous */
-
 void
 SyntaxVisitor::onLink( MD::Link< MD::QStringTrait > * l )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.linkColor );
-	format.setFont( d->styleFont( l->opts() ) );
-
-	d->setFormat( format, l->startLine(), l->startColumn(),
+	d->setFormat( SyntaxKind::Link, l->opts() | d->inheritedOpts,
+		l->startLine(), l->startColumn(),
 		l->endLine(), l->endColumn() );
 
 	if( l->p() )
 	{
-		const auto p = copyParagraphAndApplyOpts( l->p(), l->opts() );
-		onParagraph( p.get(), true );
+		// Content of the link inherits its text options.
+		const auto opts = d->inheritedOpts;
+		d->inheritedOpts |= l->opts();
+
+		onParagraph( l->p().get(), true );
+
+		d->inheritedOpts = opts;
 	}
 }
 
 void
 SyntaxVisitor::onImage( MD::Image< MD::QStringTrait > * i )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.linkColor );
-
-	d->setFormat( format, i->startLine(), i->startColumn(),
+	d->setFormat( SyntaxKind::Image, 0, i->startLine(), i->startColumn(),
 		i->endLine(), i->endColumn() );
 
 	if( i->p() )
@@ -467,20 +414,14 @@ SyntaxVisitor::onFootnoteRef( MD::FootnoteRef< MD::QStringTrait > * ref )
 {
 	if( d->doc->footnotesMap().find( ref->id() ) != d->doc->footnotesMap().cend() )
 	{
-		QTextCharFormat format;
-		format.setForeground( d->colors.linkColor );
-		format.setFont( d->styleFont( ref->opts() ) );
-
-		d->setFormat( format, ref->startLine(), ref->startColumn(),
+		d->setFormat( SyntaxKind::Link, ref->opts() | d->inheritedOpts,
+			ref->startLine(), ref->startColumn(),
 			ref->endLine(), ref->endColumn() );
 	}
 	else
 	{
-		QTextCharFormat format;
-		format.setForeground( d->colors.textColor );
-		format.setFont( d->styleFont( ref->opts() ) );
-
-		d->setFormat( format, ref->startLine(), ref->startColumn(),
+		d->setFormat( SyntaxKind::Text, ref->opts() | d->inheritedOpts,
+			ref->startLine(), ref->startColumn(),
 			ref->endLine(), ref->endColumn() );
 	}
 }
@@ -488,10 +429,7 @@ SyntaxVisitor::onFootnoteRef( MD::FootnoteRef< MD::QStringTrait > * ref )
 void
 SyntaxVisitor::onFootnote( MD::Footnote< MD::QStringTrait > * f )
 {
-	QTextCharFormat format;
-	format.setForeground( d->colors.footnoteColor );
-
-	d->setFormat( format, f->startLine(), f->startColumn(),
+	d->setFormat( SyntaxKind::Footnote, 0, f->startLine(), f->startColumn(),
 		f->endLine(), f->endColumn() );
 
 	MD::Visitor< MD::QStringTrait >::onFootnote( f );
@@ -30,11 +30,53 @@
 // Qt include.
 #include <QScopedPointer>
 
+// C++ include.
+#include <memory>
+#include <vector>
+
 
 namespace MdEditor {
 
-class Editor;
-struct Colors;
+//! Kind of highlighted item.
+enum class SyntaxKind {
+	Text,
+	Math,
+	Heading,
+	Code,
+	InlineCode,
+	Blockquote,
+	List,
+	Table,
+	Html,
+	Link,
+	Image,
+	Footnote,
+	//! Count of kinds.
+	Count
+}; // enum class SyntaxKind
+
+//! Highlighted range of the line, resolved against the text of the block when applied.
+struct SyntaxSpan {
+	//! Kind of the item.
+	SyntaxKind kind = SyntaxKind::Text;
+	//! Text options of the item.
+	int opts = 0;
+	//! Start column, -1 means position after blockquote markers.
+	long long int start = 0;
+	//! Last column, -1 means end of the block.
+	long long int end = -1;
+	//! Count of blockquotes the span is in.
+	int blockquoteDepth = 0;
+}; // struct SyntaxSpan
+
+//! Highlighted ranges of consecutive lines of the document.
+struct SyntaxSpans {
+	//! Number of the first line.
+	long long int firstLine = 0;
+	//! Spans of each line.
+	std::vector< std::vector< SyntaxSpan > > lines;
+}; // struct SyntaxSpans
+
 
 //
 // SyntaxVisitor
@@ -42,18 +84,20 @@ struct Colors;
 
 struct SyntaxVisitorPrivate;
 
-//! Markdown syntax highlighter.
+//! Builder of syntax highlighting spans of Markdown document. Doesn't touch
+//! the editor, so spans are built in the parsing thread.
 class SyntaxVisitor
 	:	public MD::Visitor< MD::QStringTrait >
 {
 public:
-	explicit SyntaxVisitor( Editor * editor );
+	SyntaxVisitor();
 	~SyntaxVisitor() override;
 
-	void highlight( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
-		const Colors & colors );
-	void setFont( const QFont & f );
-	void clearHighlighting();
+	//! \return Spans of lines [firstLine, firstLine + linesCount) of the document.
+	//! Big documents are split by top-level items and processed on all cores.
+	static std::shared_ptr< SyntaxSpans > build(
+		std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+		long long int firstLine, long long int linesCount );
 
 protected:
 	void onAddLineEnding() override;
@@ -75,6 +119,16 @@ protected:
 	void onFootnote( MD::Footnote< MD::QStringTrait > * f ) override;
 	void onListItem( MD::ListItem< MD::QStringTrait > * l, bool first ) override;
 
+private:
+	//! Build spans of top-level items [first, last) of the document.
+	void buildItems( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+		long long int first, long long int last, SyntaxSpans & spans );
+	//! Build spans of footnotes of the document.
+	void buildFootnotes( std::shared_ptr< MD::Document< MD::QStringTrait > > doc,
+		SyntaxSpans & spans );
+	//! Highlight top-level item.
+	void onItem( MD::Item< MD::QStringTrait > * item );
+
 private:
 	Q_DISABLE_COPY( SyntaxVisitor )
 
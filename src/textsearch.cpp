@@ -0,0 +1,248 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// md-editor include.
+#include "textsearch.hpp"
+
+// Qt include.
+#include <QCache>
+#include <QElapsedTimer>
+
+// C++ include.
+#include <array>
+
+
+namespace MdEditor {
+
+namespace /* anonymous */ {
+
+//! Patterns of this length and longer are found with Horspool algorithm.
+static const qsizetype c_horspoolMinLength = 6;
+
+//! Find occurrences of the pattern checking positions of its first character.
+//! QStringView::indexOf( QChar ) is vectorized by Qt, so most of the text is
+//! skipped by SIMD instructions.
+void
+findByFirstChar( QStringView text, QStringView pattern, std::vector< TextMatch > & matches )
+{
+	const auto first = pattern.front();
+	const auto rest = pattern.sliced( 1 );
+	const auto last = text.size() - pattern.size();
+
+	auto p = text.indexOf( first );
+
+	while( p >= 0 && p <= last )
+	{
+		if( text.sliced( p + 1, rest.size() ) == rest )
+		{
+			matches.push_back( { p, pattern.size() } );
+			p = text.indexOf( first, p + pattern.size() );
+		}
+		else
+			p = text.indexOf( first, p + 1 );
+	}
+}
+
+//! Find occurrences of the pattern with Horspool algorithm. Table of shifts is
+//! indexed by the low byte of UTF-16 code unit, collisions give shorter safe shifts.
+void
+findHorspool( QStringView text, QStringView pattern, std::vector< TextMatch > & matches )
+{
+	const auto m = pattern.size();
+
+	std::array< qsizetype, 256 > shift;
+	shift.fill( m );
+
+	for( qsizetype i = 0; i < m - 1; ++i )
+		shift[ pattern[ i ].unicode() & 0xFF ] = m - 1 - i;
+
+	const auto lastChar = pattern.back();
+	const auto head = pattern.first( m - 1 );
+	const auto last = text.size() - m;
+
+	qsizetype p = 0;
+
+	while( p <= last )
+	{
+		const auto c = text[ p + m - 1 ];
+
+		if( c == lastChar && text.sliced( p, m - 1 ) == head )
+		{
+			matches.push_back( { p, m } );
+			p += m;
+		}
+		else
+			p += shift[ c.unicode() & 0xFF ];
+	}
+}
+
+} /* namespace anonymous */
+
+std::vector< TextMatch >
+findAll( QStringView text, QStringView pattern )
+{
+	std::vector< TextMatch > matches;
+
+	if( pattern.isEmpty() || pattern.size() > text.size() )
+		return matches;
+
+	if( pattern.size() < c_horspoolMinLength )
+		findByFirstChar( text, pattern, matches );
+	else
+		findHorspool( text, pattern, matches );
+
+	return matches;
+}
+
+QRegularExpression
+cachedRegularExpression( const QString & pattern )
+{
+	static const int c_cacheSize = 32;
+	static QCache< QString, QRegularExpression > cache( c_cacheSize );
+
+	auto re = cache.object( pattern );
+
+	if( !re )
+	{
+		re = new QRegularExpression( pattern, QRegularExpression::UseUnicodePropertiesOption );
+
+		// JIT compilation is done once here instead of on the first match.
+		re->optimize();
+
+		cache.insert( pattern, re );
+	}
+
+	return *re;
+}
+
+RegExpSearchResult
+forEachMatch( QStringView text, const QRegularExpression & re, qint64 timeBudget,
+	const std::function< void( const QRegularExpressionMatch &, qsizetype ) > & func )
+{
+	if( !re.isValid() || re.pattern().isEmpty() )
+		return RegExpSearchResult::Finished;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	qsizetype start = 0;
+
+	while( start <= text.size() )
+	{
+		auto end = text.indexOf( QChar::ParagraphSeparator, start );
+
+		if( end < 0 )
+			end = text.size();
+
+		// Lines are matched separately, so time is checked between them.
+		auto it = re.globalMatchView( text.sliced( start, end - start ) );
+
+		while( it.hasNext() )
+		{
+			const auto m = it.next();
+
+			if( m.capturedLength() > 0 )
+				func( m, start );
+
+			if( timer.elapsed() > timeBudget )
+				return RegExpSearchResult::TimedOut;
+		}
+
+		// Iterator is invalid if PCRE failed with an error, e.g. match limit
+		// was hit, Qt doesn't report it otherwise.
+		if( !it.isValid() )
+			return RegExpSearchResult::Failed;
+
+		if( timer.elapsed() > timeBudget )
+			return RegExpSearchResult::TimedOut;
+
+		start = end + 1;
+	}
+
+	return RegExpSearchResult::Finished;
+}
+
+std::vector< TextMatch >
+findAll( QStringView text, const QRegularExpression & re,
+	qint64 timeBudget, RegExpSearchResult * result )
+{
+	std::vector< TextMatch > matches;
+
+	const auto r = forEachMatch( text, re, timeBudget,
+		[&matches]( const QRegularExpressionMatch & m, qsizetype offset )
+		{
+			matches.push_back( { offset + m.capturedStart(), m.capturedLength() } );
+		} );
+
+	if( result )
+		*result = r;
+
+	return matches;
+}
+
+QString
+substituteCaptures( const QRegularExpressionMatch & match, QStringView with )
+{
+	QString result;
+	result.reserve( with.size() );
+
+	for( qsizetype i = 0; i < with.size(); ++i )
+	{
+		const auto c = with[ i ];
+
+		if( ( c == QLatin1Char( '\\' ) || c == QLatin1Char( '$' ) ) && i + 1 < with.size() )
+		{
+			const auto n = with[ i + 1 ];
+
+			if( n.isDigit() )
+			{
+				int group = n.digitValue();
+				++i;
+
+				// Two digits reference group only if there is such group.
+				if( i + 1 < with.size() && with[ i + 1 ].isDigit() &&
+					group * 10 + with[ i + 1 ].digitValue() <=
+						match.regularExpression().captureCount() )
+				{
+					group = group * 10 + with[ i + 1 ].digitValue();
+					++i;
+				}
+
+				result.append( match.captured( group ) );
+
+				continue;
+			}
+			else if( n == c )
+			{
+				result.append( c );
+				++i;
+
+				continue;
+			}
+		}
+
+		result.append( c );
+	}
+
+	return result;
+}
+
+} /* namespace MdEditor */
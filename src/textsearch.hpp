@@ -0,0 +1,84 @@
+/*!
+	\file
+
+	\author Igor Mironchik (igor.mironchik at gmail dot com).
+
+	Copyright (c) 2023-2024 Igor Mironchik
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Qt include.
+#include <QStringView>
+#include <QRegularExpression>
+
+// C++ include.
+#include <vector>
+#include <functional>
+
+
+namespace MdEditor {
+
+//
+// TextMatch
+//
+
+//! Occurrence of the pattern in the text.
+struct TextMatch {
+	//! Position of the first character.
+	qsizetype start = 0;
+	//! Length of the occurrence.
+	qsizetype length = 0;
+}; // struct TextMatch
+
+//! \return Sorted not overlapping occurrences of the pattern in the text,
+//! search is case sensitive and done in one pass.
+//! Short patterns are found by the vectorized search of the first character,
+//! long ones with Horspool algorithm.
+std::vector< TextMatch > findAll( QStringView text, QStringView pattern );
+
+//! Result of search with regular expression.
+enum class RegExpSearchResult {
+	//! All lines were searched.
+	Finished,
+	//! Search didn't finish in time budget.
+	TimedOut,
+	//! Matching of a line failed, e.g. on PCRE's match limit with catastrophic backtracking.
+	Failed
+}; // enum class RegExpSearchResult
+
+//! \return Compiled and JIT optimized regular expression. Expressions are
+//! cached by pattern, so each one is compiled once. Not thread-safe.
+QRegularExpression cachedRegularExpression( const QString & pattern );
+
+//! Call \a func for each not empty match of the regular expression in one
+//! forward pass over lines of the raw text of the document, \a offset of the
+//! line is passed with the match. Lines are separated by QChar::ParagraphSeparator.
+//! Search stops if it doesn't finish in \a timeBudget milliseconds or matching fails.
+RegExpSearchResult forEachMatch( QStringView text, const QRegularExpression & re,
+	qint64 timeBudget,
+	const std::function< void( const QRegularExpressionMatch &, qsizetype ) > & func );
+
+//! \return Sorted occurrences of the regular expression in lines of the text,
+//! \a result is set to the result of the search.
+std::vector< TextMatch > findAll( QStringView text, const QRegularExpression & re,
+	qint64 timeBudget, RegExpSearchResult * result = nullptr );
+
+//! \return Replacement of the match, \1 or $1 references to captured groups
+//! are substituted, \\ and $$ are replaced with \ and $.
+QString substituteCaptures( const QRegularExpressionMatch & match, QStringView with );
+
+} /* namespace MdEditor */